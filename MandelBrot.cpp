@@ -1,10 +1,41 @@
 #include "raylib.h"
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+// The iteration file reader memory-maps its input
+#if defined(_WIN32)
+// Keep windows.h from clashing with raylib (Rectangle, CloseWindow, ...)
+#define WIN32_LEAN_AND_MEAN
+#define NOGDI
+#define NOUSER
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /* Mandelbrot Set Visualization */
 
 /*
@@ -13,187 +44,5490 @@ we are computing if it escapes the boundary of value 2
 as we know if it escapes beyond 2 then it is unstable.
 */
 
-/*
-    Efficiency Increasing:
-    - The Mandelbrot set is symmetric about the real axis.
-      We can compute only the upper half and mirror it to the lower half.
+/*
+    Efficiency Increasing:
+    - The Mandelbrot set is symmetric about the real axis.
+      We can compute only the upper half and mirror it to the lower half.
+
+    - Many Points are known to be in the Mandelbrot set.
+      We can skip computations for these points.
+        - Points within the main cardioid -> Single check!
+        - Points within the period-2 bulb -> Single check!
+
+    -
+
+
+
+
+*/
+
+/* constants for the graphics!*/
+const int WIDTH = 900;
+const int HEIGHT = 900;
+const int MAX_ITER = 100;
+const int TILE_SIZE = 64; // Tile-based rendering for better load balancing
+
+// Global variables for interaction
+static Vector2 lastMousePos = {0, 0};
+static bool isDragging = false;
+static bool needsRedraw = true;
+static const double MIN_MOVEMENT =
+    2.0; // Minimum pixel movement to trigger redraw
+static const double DRAG_SENSITIVITY =
+    1.0; // Adjust this to make dragging faster/slower
+static bool isFullscreen = false;
+
+// Splash screen state
+static bool showSplashScreen = true;
+static double splashTime = 0.0;
+
+/*
+    Render timeline tracing (Chrome trace-event JSON)
+
+    Press T to start recording and T again to stop. The trace is written to
+    mandelbrot_trace_<n>.json which opens directly in Perfetto
+    (ui.perfetto.dev) or chrome://tracing.
+
+    Every event is a "complete" event (ph = "X") with a start and a duration
+    in microseconds. tid 0 is the UI thread, tid 1..N are the render workers
+    and tid N+1 is the background render thread that drives each pass, so
+    load imbalance between workers shows up as ragged lane ends.
+
+    When tracing is off the only cost is one relaxed atomic load per render
+    pass: workers get a null sink and every TraceSpan turns into a no-op.
+*/
+struct TraceEvent {
+  const char *name; // Must be a string literal, we only keep the pointer
+  const char *cat;
+  int tid;
+  int64_t ts;  // Start, microseconds since the recording started
+  int64_t dur; // Duration in microseconds
+  int tileX;   // Tile coordinates for "tile" events, -1 otherwise
+  int tileY;
+};
+
+static std::atomic<bool> traceEnabled{false};
+static std::mutex traceMutex; // Guards traceEvents, taken once per pass
+static std::vector<TraceEvent> traceEvents;
+static std::chrono::steady_clock::time_point traceEpoch;
+static int traceFileCounter = 0;
+
+inline int64_t TraceNow() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - traceEpoch)
+      .count();
+}
+
+// Returns the sink a thread should record into, or nullptr when disabled
+inline std::vector<TraceEvent> *TraceSink(std::vector<TraceEvent> &local) {
+  return traceEnabled.load(std::memory_order_relaxed) ? &local : nullptr;
+}
+
+// Scoped span: records [construction, destruction) into the sink if any
+struct TraceSpan {
+  std::vector<TraceEvent> *sink;
+  TraceEvent event;
+
+  TraceSpan(std::vector<TraceEvent> *sink, const char *name, const char *cat,
+            int tid, int tileX = -1, int tileY = -1)
+      : sink(sink) {
+    if (sink)
+      event = {name, cat, tid, TraceNow(), 0, tileX, tileY};
+  }
+
+  ~TraceSpan() {
+    if (sink) {
+      event.dur = TraceNow() - event.ts;
+      sink->push_back(event);
+    }
+  }
+};
+
+// Threads buffer events locally and hand them over in one go
+void TraceSubmit(std::vector<TraceEvent> &local) {
+  if (local.empty())
+    return;
+  std::lock_guard<std::mutex> lock(traceMutex);
+  if (traceEnabled.load(std::memory_order_relaxed))
+    traceEvents.insert(traceEvents.end(), local.begin(), local.end());
+  local.clear();
+}
+
+void TraceStart() {
+  std::lock_guard<std::mutex> lock(traceMutex);
+  traceEvents.clear();
+  traceEpoch = std::chrono::steady_clock::now();
+  traceEnabled.store(true, std::memory_order_relaxed);
+}
+
+// Stops recording and writes the JSON file, returns false on I/O failure
+bool TraceStopAndWrite(int numThreads) {
+  std::lock_guard<std::mutex> lock(traceMutex);
+  traceEnabled.store(false, std::memory_order_relaxed);
+
+  std::string path =
+      "mandelbrot_trace_" + std::to_string(traceFileCounter++) + ".json";
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+  // Metadata events give the lanes readable names in the viewer
+  fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":0,\"args\":{\"name\":\"UI thread\"}}");
+  for (int t = 0; t < numThreads; t++) {
+    fprintf(file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}",
+            t + 1, t);
+  }
+  fprintf(file,
+          ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"tid\":%d,\"args\":{\"name\":\"render thread\"}}",
+          numThreads + 1);
+
+  for (const TraceEvent &e : traceEvents) {
+    fprintf(file,
+            ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+            "\"tid\":%d,\"ts\":%lld,\"dur\":%lld",
+            e.name, e.cat, e.tid, (long long)e.ts, (long long)e.dur);
+    if (e.tileX >= 0)
+      fprintf(file, ",\"args\":{\"tileX\":%d,\"tileY\":%d}", e.tileX,
+              e.tileY);
+    fputc('}', file);
+  }
+
+  fprintf(file, "\n]}\n");
+  traceEvents.clear();
+  return fclose(file) == 0;
+}
+
+/*
+    Hot-path counters
+
+    Build with -DMANDELBROT_COUNTERS (make counters) to count how often each
+    early exit in mandelbrotEscape fires, how many iterated pixels escape or
+    hit the limit, and how many iterations were spent in total.
+
+    Each worker counts into its own thread_local copy, so the hot path never
+    touches shared memory; the copies are merged once at the end of a frame.
+    Without the flag COUNT_EVENT compiles to nothing.
+*/
+struct EscapeCounters {
+  uint64_t cardioid = 0;   // Early exit: inside main cardioid
+  uint64_t bulb = 0;       // Early exit: inside period-2 bulb
+  uint64_t radius = 0;     // Early exit: |c| > 2
+  uint64_t interior = 0;   // Orbit found attracted to a cycle (interior)
+  uint64_t escaped = 0;    // Iterated pixels that escaped
+  uint64_t maxIter = 0;    // Iterated pixels that hit the iteration limit
+  uint64_t iterations = 0; // Total loop iterations
+
+  void Merge(const EscapeCounters &other) {
+    cardioid += other.cardioid;
+    bulb += other.bulb;
+    radius += other.radius;
+    interior += other.interior;
+    escaped += other.escaped;
+    maxIter += other.maxIter;
+    iterations += other.iterations;
+  }
+
+  uint64_t Pixels() const {
+    return cardioid + bulb + radius + interior + escaped + maxIter;
+  }
+};
+
+#ifdef MANDELBROT_COUNTERS
+static constexpr bool COUNTERS_ENABLED = true;
+static thread_local EscapeCounters threadCounters;
+#define COUNT_EVENT(field, amount) (threadCounters.field += (amount))
+#else
+static constexpr bool COUNTERS_ENABLED = false;
+#define COUNT_EVENT(field, amount) ((void)0)
+#endif
+
+/* Faster than std::complex!*/
+struct Complex {
+  double real;
+  double imag;
+};
+
+/*
+    Formulas
+
+    Each formula is a struct whose static Step advances an orbit by one
+    iteration, z -> f(z) + c, as a template over the number type. The
+    kernels below are templates over the formula, so every instance has
+    its step inlined and specialized at compile time (the Multibrot power
+    loop has a constant trip count and unrolls) and the hot loops never
+    branch on which formula they run. FORMULAS picks the instance at run
+    time, once per pixel or group of lanes.
+
+    Step gets zx^2 and zy^2 precomputed, the loops need them for the
+    bailout anyway. power is the degree, which the smooth count scales
+    by. Derivative multiplies der by f'(z) for interior detection, which
+    is off where f isn't conformal (Burning Ship); those interiors run to
+    max_iter. The cardioid and bulb checks and the distance estimates
+    only exist for z^2 + c.
+*/
+struct Mandelbrot {
+  static const int power = 2;
+  static const bool cardioidChecks = true;
+  static const bool interiorDetection = true;
+  static const bool distanceEstimation = true;
+
+  template <typename Real>
+  static void Step(Real &zx, Real &zy, Real zx2, Real zy2, Real cx, Real cy) {
+    zy = 2 * zx * zy + cy;
+    zx = zx2 - zy2 + cx;
+  }
+
+  // der *= 2z
+  template <typename Real>
+  static void Derivative(Real zx, Real zy, Real &derX, Real &derY) {
+    Real t = 2 * (zx * derX - zy * derY);
+    derY = 2 * (zx * derY + zy * derX);
+    derX = t;
+  }
+};
+
+// z^Power + c
+template <int Power> struct Multibrot {
+  static_assert(Power >= 3, "z^2 + c is Mandelbrot");
+  static const int power = Power;
+  static const bool cardioidChecks = false;
+  static const bool interiorDetection = true;
+  static const bool distanceEstimation = false;
+
+  // z^K from z and its squared parts, K >= 2
+  template <int K, typename Real>
+  static void Pow(Real zx, Real zy, Real zx2, Real zy2, Real &px, Real &py) {
+    px = zx2 - zy2;
+    py = 2 * zx * zy;
+    for (int k = 2; k < K; k++) {
+      Real t = px * zx - py * zy;
+      py = px * zy + py * zx;
+      px = t;
+    }
+  }
+
+  template <typename Real>
+  static void Step(Real &zx, Real &zy, Real zx2, Real zy2, Real cx, Real cy) {
+    Real px, py;
+    Pow<Power>(zx, zy, zx2, zy2, px, py);
+    zx = px + cx;
+    zy = py + cy;
+  }
+
+  // der *= Power * z^(Power - 1)
+  template <typename Real>
+  static void Derivative(Real zx, Real zy, Real &derX, Real &derY) {
+    Real px, py;
+    Pow<Power - 1>(zx, zy, zx * zx, zy * zy, px, py);
+    Real t = Power * (px * derX - py * derY);
+    derY = Power * (px * derY + py * derX);
+    derX = t;
+  }
+};
+
+// (|x| + i|y|)^2 + c
+struct BurningShip {
+  static const int power = 2;
+  static const bool cardioidChecks = false;
+  static const bool interiorDetection = false;
+  static const bool distanceEstimation = false;
+
+  template <typename Real>
+  static void Step(Real &zx, Real &zy, Real zx2, Real zy2, Real cx, Real cy) {
+    zy = 2 * std::abs(zx * zy) + cy;
+    zx = zx2 - zy2 + cx;
+  }
+};
+
+// conj(z)^2 + c, the Mandelbar. |f'| is |2z| as for Mandelbrot, which is
+// all interior detection looks at.
+struct Tricorn : Mandelbrot {
+  static const bool cardioidChecks = false;
+  static const bool distanceEstimation = false;
+
+  template <typename Real>
+  static void Step(Real &zx, Real &zy, Real zx2, Real zy2, Real cx, Real cy) {
+    zy = -2 * zx * zy + cy;
+    zx = zx2 - zy2 + cx;
+  }
+};
+
+/*
+    Smooth (continuous) iteration count
+
+    The escape count n jumps by one between neighbouring bands. The
+    normalized count
+        mu = n + 1 - log2(log|z_n|)
+    interpolates between them using how far past the bailout the orbit
+    landed. With the bailout radius of 2 that estimate is still skewed, so
+    the orbit is followed for SMOOTH_EXTRA_ITERATIONS more steps first
+    (n grows by the same amount), which makes the bands blend seamlessly.
+
+    The two logarithms use FastLog2: exponent bits plus a short odd
+    polynomial for the mantissa, accurate to about 2e-5. It has no
+    branches or libm calls, so a loop over pixels can vectorize.
+*/
+static const int SMOOTH_EXTRA_ITERATIONS = 4;
+static const double LN2 = 0.6931471805599453;
+
+// log2(x) for positive, finite, normal x
+inline double FastLog2(double x) {
+  uint64_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  double exponent = (double)((int64_t)(bits >> 52) - 1023);
+
+  // Mantissa m in [1, 2), log2(m) = 2/ln2 * atanh((m - 1) / (m + 1))
+  bits = (bits & 0x000FFFFFFFFFFFFFull) | 0x3FF0000000000000ull;
+  double m;
+  memcpy(&m, &bits, sizeof(m));
+  double t = (m - 1.0) / (m + 1.0);
+  double t2 = t * t;
+  double series = t * (1.0 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 * (1.0 / 7))));
+  return exponent + series * (2.0 / LN2);
+}
+
+// mu for an orbit that escaped with z = z_n, see above. For degree d the
+// log2 becomes log_d, as |z| grows to its d-th power per step.
+template <typename Formula = Mandelbrot>
+inline float SmoothIterationCount(double zx, double zy, double cx, double cy,
+                                  int n) {
+  double modulus2 = zx * zx + zy * zy;
+  // Stop early on huge orbits so |z|^2 can't overflow
+  for (int k = 0; k < SMOOTH_EXTRA_ITERATIONS && modulus2 < 1e16; k++) {
+    Formula::Step(zx, zy, zx * zx, zy * zy, cx, cy);
+    modulus2 = zx * zx + zy * zy;
+    n++;
+  }
+  // log|z| = log2(|z|^2) * ln2 / 2
+  double logLog = FastLog2(0.5 * LN2 * FastLog2(modulus2));
+  if constexpr (Formula::power != 2)
+    logLog /= FastLog2(Formula::power);
+  double mu = n + 1 - logLog;
+  return (float)std::max(0.0, mu);
+}
+
+/*
+    Interior detection
+
+    The cardioid and bulb checks only cover the two largest components;
+    every other interior pixel used to run all max_iter iterations. The
+    kernels therefore watch for the orbit closing up on a cycle, Brent
+    style: they keep a reference point z(r), move it up to the current z
+    at steps ever further apart (a quarter of the steps so far, at least
+    INTERIOR_MIN_INTERVAL), and the orbit has closed once some z(n) comes
+    back to within the tolerance of it. Next to z they track
+        der(n+1) = f'(z(n+1)) * der(n)
+    restarted at 1 whenever the reference moves, so on closing der is the
+    multiplier of the cycle of period n - r. Only an attracting cycle,
+    |der| < 1, makes the point interior; the loop then stops early with
+    n = max_iter, as if it had run to the end.
+
+    der alone is no proof: near a minibrot an escaping orbit passes close
+    to 0 and the product shrinks anyway. Such an orbit never repeats
+    itself to within the tolerance though, which sits a little above the
+    rounding of each precision (INTERIOR_CLOSE2 for double,
+    INTERIOR_CLOSE2_FLOAT and INTERIOR_CLOSE2_DD), far below the scale of
+    the orbit's own dynamics down to the deepest zoom.
+
+    der only matters below 1, so once it grows past INTERIOR_RESCALE2 it
+    is pinned at INTERIOR_RESCALE to stay finite until the next restart.
+*/
+static const int INTERIOR_MIN_INTERVAL = 16;
+static const double INTERIOR_CLOSE2 = 1e-28;
+static const float INTERIOR_CLOSE2_FLOAT = 1e-12f;
+static const double INTERIOR_CLOSE2_DD = 1e-56;
+static const double INTERIOR_RESCALE = 1e15;
+static const double INTERIOR_RESCALE2 = INTERIOR_RESCALE * INTERIOR_RESCALE;
+
+// Step at which the reference point moves next, after moving at step n
+inline int NextInteriorReference(int n) {
+  return n + std::max(INTERIOR_MIN_INTERVAL, n / 4);
+}
+
+/*
+    Julia sets
+
+    The same maps with the roles swapped: c is one fixed point for the
+    whole image and every pixel is the start z_0 of its own orbit. Each
+    kernel takes a Julia flag as template parameter and that c as its
+    last argument, which the Mandelbrot instances ignore; in a Julia
+    instance the pixel arguments (cx, cy) are z_0. The cardioid and bulb
+    checks describe the Mandelbrot set and are skipped, the radius check
+    holds for both as long as |c| <= 2, so every c is taken through
+    JuliaParameter first.
+*/
+
+// c moved onto the circle |c| = 2 if it lies outside. Those Julia sets
+// are dust that hardly changes past it, and the kernels' bailout at
+// |z| = 2 stays exact for all of them.
+inline Complex JuliaParameter(Complex c) {
+  double modulus2 = c.real * c.real + c.imag * c.imag;
+  if (modulus2 <= 4.0)
+    return c;
+  double scale = 2.0 / sqrt(modulus2);
+  return {c.real * scale, c.imag * scale};
+}
+
+/* Optimized Mandelbrot function with fast math */
+// inline is hint to the compiler for optimization
+// If smooth is given it receives the smooth iteration count
+// Real is the type the orbit is iterated in, see KernelPrecision, and
+// Formula the map it iterates, see Formulas
+template <typename Real, typename Formula = Mandelbrot, bool Julia = false>
+inline int mandelbrotEscapeIn(double cx, double cy, int max_iter,
+                              float *smooth, Complex julia = {0.0, 0.0}) {
+  // Julia sets start the orbit at the pixel and add the fixed c
+  double startX = 0.0, startY = 0.0;
+  if constexpr (Julia) {
+    startX = cx;
+    startY = cy;
+    cx = julia.real;
+    cy = julia.imag;
+  }
+
+  // Quick escape checks first
+
+  if constexpr (Formula::cardioidChecks && !Julia) {
+    /* Cardioid check
+
+      q = (x - 0.25)^2 + y^2
+      (q * (q + (x - 0.25)) < 0.25 * y^2) -> inside cardioid
+
+    */
+
+    double q = (cx - 0.25) * (cx - 0.25) + cy * cy;
+    if (q * (q + (cx - 0.25)) < 0.25 * cy * cy) {
+      COUNT_EVENT(cardioid, 1);
+      if (smooth)
+        *smooth = (float)max_iter;
+      return max_iter;
+    }
+
+    /*
+      Bulb Check
+      (x + 1)^2 + y^2 < 1/16 -> inside period-2 bulb
+    */
+
+    if ((cx + 1) * (cx + 1) + cy * cy < 0.0625) {
+      COUNT_EVENT(bulb, 1);
+      if (smooth)
+        *smooth = (float)max_iter;
+      return max_iter;
+    }
+  }
+
+  /*
+    Outside check
+    x^2 + y^2 > 4 -> definitely outside
+
+  */
+
+  if constexpr (Julia) {
+    if (startX * startX + startY * startY > 4.0) {
+      COUNT_EVENT(radius, 1);
+      // z_0 is past the bailout already
+      if (smooth)
+        *smooth = SmoothIterationCount<Formula>(startX, startY, cx, cy, 0);
+      return 0;
+    }
+  } else if (cx * cx + cy * cy > 4.0) {
+    COUNT_EVENT(radius, 1);
+    // Already z_1 = c is past the bailout, for every formula
+    if (smooth)
+      *smooth = SmoothIterationCount<Formula>(cx, cy, cx, cy, 1);
+    return 0;
+  }
+
+  // Fast iteration using registers
+  Real x0 = (Real)cx, y0 = (Real)cy;
+  Real zx = (Real)startX, zy = (Real)startY;
+  Real zx2, zy2;
+  Real derX = 1, derY = 0, der2 = 1;
+  Real refX = zx, refY = zy; // Interior detection, see above
+  const Real close2 = std::is_same_v<Real, float>
+                          ? (Real)INTERIOR_CLOSE2_FLOAT
+                          : (Real)INTERIOR_CLOSE2;
+  int nextRef = INTERIOR_MIN_INTERVAL;
+  bool closed = false;
+  int n = 0;
+
+  /*
+    The escape time algorithm is based on the iterative function:
+        z(n+1) = z(n)² + c
+    where z and c are complex numbers.
+
+    In terms of real and imaginary parts:
+        z = zx + i*zy
+        c = cx + i*cy
+
+    Squaring a complex number:
+        z² = (zx + i*zy)² = zx² - zy² + 2*i*zx*zy
+
+    Therefore, the iteration becomes:
+        zx(n+1) = zx(n)² - zy(n)² + cx
+        zy(n+1) = 2*zx(n)*zy(n) + cy
+    which is Mandelbrot::Step; other formulas bring their own.
+  */
+
+  //  We unroll the loop for performance!
+  do {
+    zx2 = zx * zx;
+    zy2 = zy * zy;
+    Formula::Step(zx, zy, zx2, zy2, x0, y0);
+    n++;
+    if constexpr (Formula::interiorDetection) {
+      // Interior detection, see above
+      Formula::Derivative(zx, zy, derX, derY);
+      der2 = derX * derX + derY * derY;
+      if (der2 > (Real)INTERIOR_RESCALE2) {
+        derX = (Real)INTERIOR_RESCALE;
+        derY = 0;
+      }
+      Real ex = zx - refX, ey = zy - refY;
+      closed = ex * ex + ey * ey < close2 && der2 < 1;
+      if (n == nextRef) {
+        refX = zx;
+        refY = zy;
+        derX = 1;
+        derY = 0;
+        nextRef = NextInteriorReference(n);
+      }
+    }
+  } while (zx2 + zy2 <= 4 && n < max_iter && !closed);
+
+  COUNT_EVENT(iterations, n);
+  if (closed) {
+    COUNT_EVENT(interior, 1);
+    n = max_iter;
+  } else if (n == max_iter) {
+    COUNT_EVENT(maxIter, 1);
+  } else {
+    COUNT_EVENT(escaped, 1);
+  }
+
+  if (smooth)
+    *smooth = n == max_iter ? (float)max_iter
+                            : SmoothIterationCount<Formula>(zx, zy, cx, cy, n);
+  return n;
+}
+
+inline int mandelbrotEscape(double cx, double cy, int max_iter,
+                            float *smooth = nullptr) {
+  return mandelbrotEscapeIn<double>(cx, cy, max_iter, smooth);
+}
+
+/*
+    Raw per-pixel escape data, for saving and recoloring without iterating
+
+    smooth is the normalized iteration count (see SmoothIterationCount)
+    which varies continuously across the iteration bands. Pixels that
+    never escape get mu = maxIter.
+*/
+struct EscapeSample {
+  uint32_t iterations;
+  float smooth;
+  float distance; // Distance estimate, 0 when not computed
+};
+
+/*
+    Kernel precision
+
+    While the pixels are far apart, float resolves c and the orbit well
+    enough: every |c| and |z| that matters is at most 2, so float rounds
+    them by at most 2^-22, and rounding in the loop is amplified no more
+    than a change of c is. As long as that stays a small fraction of the
+    pixel spacing, float and double only disagree on the odd chaotic
+    boundary pixel, which is noise at either precision. FLOAT_MIN_SPACING
+    keeps that margin at 256x, so zooming across the switch shows no seam.
+    The same margin over double's 2^-51 gives DOUBLE_MIN_SPACING, below
+    which the double-double kernel takes over, and over double-double's
+    2^-104 DOUBLE_DOUBLE_MIN_SPACING, the deepest zoom there is. Below
+    that neighbouring pixels would merge, so no view goes deeper.
+
+    The choice depends on the spacing alone, never on where the view is,
+    so the pixels of a grid tile come out the same in every view and the
+    tile caches stay valid across the switch.
+
+    mandelbrotFloatLanes iterates FLOAT_LANES points in lock step, like
+    mandelbrotDistanceLanes; with float twice as many lanes fit in a
+    vector register as with double. It does the same math as
+    mandelbrotEscapeIn<float>, lane by lane.
+*/
+enum KernelPrecision {
+  PRECISION_FLOAT,
+  PRECISION_DOUBLE,
+  PRECISION_DOUBLE_DOUBLE
+};
+
+static const double FLOAT_MIN_SPACING = 0x1p-14;
+static const double DOUBLE_MIN_SPACING = 0x1p-43;
+static const double DOUBLE_DOUBLE_MIN_SPACING = 0x1p-96;
+static const int FLOAT_LANES = 8;
+
+inline KernelPrecision PrecisionForSpacing(double spacing) {
+  if (spacing >= FLOAT_MIN_SPACING)
+    return PRECISION_FLOAT;
+  return spacing >= DOUBLE_MIN_SPACING ? PRECISION_DOUBLE
+                                       : PRECISION_DOUBLE_DOUBLE;
+}
+
+// FLOAT_LANES points at once, results in out. The smooth count is only
+// computed when wantSmooth is set.
+template <typename Formula, bool Julia = false>
+void mandelbrotFloatLanes(const double *cx, const double *cy, int maxIter,
+                          bool wantSmooth, EscapeSample *out,
+                          Complex julia = {0.0, 0.0}) {
+  float x0[FLOAT_LANES], y0[FLOAT_LANES];
+  float zx[FLOAT_LANES] = {}, zy[FLOAT_LANES] = {};
+  float derX[FLOAT_LANES], derY[FLOAT_LANES] = {};
+  float refX[FLOAT_LANES], refY[FLOAT_LANES]; // Interior detection
+  int closed[FLOAT_LANES] = {};
+  int n[FLOAT_LANES] = {};
+  int active[FLOAT_LANES];
+  int anyActive = 0;
+  int steps = 0, nextRef = INTERIOR_MIN_INTERVAL;
+
+  // Points the early checks settle go through the scalar kernel
+  for (int l = 0; l < FLOAT_LANES; l++) {
+    bool settled = cx[l] * cx[l] + cy[l] * cy[l] > 4.0;
+    if constexpr (Formula::cardioidChecks && !Julia) {
+      double q = (cx[l] - 0.25) * (cx[l] - 0.25) + cy[l] * cy[l];
+      settled = settled || q * (q + (cx[l] - 0.25)) < 0.25 * cy[l] * cy[l] ||
+                (cx[l] + 1) * (cx[l] + 1) + cy[l] * cy[l] < 0.0625;
+    }
+    if constexpr (Julia) {
+      x0[l] = (float)julia.real;
+      y0[l] = (float)julia.imag;
+      zx[l] = (float)cx[l];
+      zy[l] = (float)cy[l];
+    } else {
+      x0[l] = (float)cx[l];
+      y0[l] = (float)cy[l];
+    }
+    derX[l] = 1;
+    refX[l] = zx[l];
+    refY[l] = zy[l];
+    active[l] = !settled;
+    anyActive |= active[l];
+    if (settled) {
+      out[l].smooth = 0.0f;
+      out[l].iterations = (uint32_t)mandelbrotEscapeIn<double, Formula, Julia>(
+          cx[l], cy[l], maxIter, wantSmooth ? &out[l].smooth : nullptr, julia);
+      out[l].distance = 0.0f;
+    }
+  }
+
+  // Lock-step iteration, finished lanes keep their values
+  while (anyActive) {
+    anyActive = 0;
+    for (int l = 0; l < FLOAT_LANES; l++) {
+      float x = zx[l], y = zy[l];
+      float x2 = x * x, y2 = y * y;
+      bool step = active[l];
+      float nx = x, ny = y;
+      Formula::Step(nx, ny, x2, y2, x0[l], y0[l]);
+      float t = derX[l], u = derY[l], d2 = 2.0f;
+      if constexpr (Formula::interiorDetection) {
+        Formula::Derivative(nx, ny, t, u);
+        d2 = t * t + u * u;
+      }
+      bool rescale = d2 > (float)INTERIOR_RESCALE2;
+      float ex = nx - refX[l], ey = ny - refY[l];
+      bool close = (ex * ex + ey * ey < INTERIOR_CLOSE2_FLOAT) & (d2 < 1.0f);
+      zx[l] = step ? nx : x;
+      zy[l] = step ? ny : y;
+      derX[l] = !step ? derX[l] : rescale ? (float)INTERIOR_RESCALE : t;
+      derY[l] = !step ? derY[l] : rescale ? 0.0f : u;
+      closed[l] = step ? close : closed[l];
+      n[l] += active[l];
+      active[l] = active[l] & (x2 + y2 <= 4.0f) & (n[l] < maxIter) & !close;
+      anyActive |= active[l];
+    }
+    // Interior detection: move the reference points, see above
+    if (++steps == nextRef) {
+      for (int l = 0; l < FLOAT_LANES; l++) {
+        refX[l] = zx[l];
+        refY[l] = zy[l];
+        derX[l] = 1;
+        derY[l] = 0;
+      }
+      nextRef = NextInteriorReference(steps);
+    }
+  }
+
+  for (int l = 0; l < FLOAT_LANES; l++) {
+    if (n[l] == 0)
+      continue; // Settled above
+    COUNT_EVENT(iterations, n[l]);
+    out[l].iterations = (uint32_t)n[l];
+    out[l].smooth = 0.0f;
+    out[l].distance = 0.0f;
+    if (closed[l]) {
+      COUNT_EVENT(interior, 1);
+      out[l].iterations = (uint32_t)maxIter;
+      out[l].smooth = (float)maxIter;
+    } else if (n[l] == maxIter) {
+      COUNT_EVENT(maxIter, 1);
+      out[l].smooth = (float)maxIter;
+    } else {
+      COUNT_EVENT(escaped, 1);
+      if (wantSmooth)
+        out[l].smooth = SmoothIterationCount<Formula>(
+            zx[l], zy[l], Julia ? julia.real : cx[l],
+            Julia ? julia.imag : cy[l], n[l]);
+    }
+  }
+}
+
+/*
+    Exterior distance estimation
+
+    Next to z this kernel tracks the derivative dz/dc,
+        dz(n+1) = 2 * z(n) * dz(n) + 1
+    and once the orbit is far out, the distance from c to the boundary of
+    the set is about (within a factor of 2)
+        d = |z| * log|z| / |dz|
+    That shades filaments by their true width, however thin, and tells
+    when a pixel is far from the boundary and needs no extra samples.
+
+    Escape count and smooth value are exactly those of mandelbrotEscape;
+    only for the estimate is the orbit followed further out, to
+    DE_BAILOUT2, where it is accurate. Points found inside the set get
+    the interior estimate below instead, or 0 if none could be made.
+
+    mandelbrotDistanceLanes runs DE_LANES points in lock step over plain
+    arrays with selects instead of branches, which the compiler turns into
+    SIMD code with the Makefile's -O3 -march=native. It does the same math
+    as the scalar kernel, lane by lane.
+*/
+static const double DE_BAILOUT2 = 1e12; // |z|^2 the estimate is taken at
+static const int DE_MAX_EXTRA = 32;     // Steps allowed to get there
+static const int DE_LANES = 4;
+
+// Follows an escaped orbit (z, dz) out to DE_BAILOUT2, returns the distance
+inline float DistanceFromEscaped(double zx, double zy, double dx, double dy,
+                                 double cx, double cy) {
+  double modulus2 = zx * zx + zy * zy;
+  for (int k = 0; k < DE_MAX_EXTRA && modulus2 < DE_BAILOUT2; k++) {
+    double ndx = 2 * (zx * dx - zy * dy) + 1;
+    double ndy = 2 * (zx * dy + zy * dx);
+    double x = zx * zx - zy * zy + cx;
+    zy = 2 * zx * zy + cy;
+    zx = x;
+    dx = ndx;
+    dy = ndy;
+    modulus2 = zx * zx + zy * zy;
+  }
+  // |z| log|z| / |dz| with log|z| = log2(|z|^2) * ln2 / 2
+  double derivative2 = dx * dx + dy * dy;
+  if (!(derivative2 > 0.0) || derivative2 > 1e300)
+    return 0.0f;
+  return (float)(sqrt(modulus2 / derivative2) * 0.5 * LN2 *
+                 FastLog2(modulus2));
+}
+
+/*
+    Interior distance estimation
+
+    Once interior detection has stopped an orbit, z sits close to the
+    attracting cycle. Its period p is the first return of the orbit to
+    within INTERIOR_PERIOD_TOLERANCE2 of z, and a few Newton steps on
+    f^p(z) - z = 0 move z onto the cycle exactly. Along one period the
+    derivatives of f^p with respect to z and c then give the distance
+    from c to the boundary of its component:
+        d = (1 - |dz|^2) / |dcdz + dzdz * dc / (1 - dz)|
+    dz is the multiplier of the cycle, so |dz| < 1 confirms the point is
+    interior. Like the exterior estimate it is good within a factor of 4.
+    The cost is a few times p steps, paid only by detected interior
+    pixels, which saved far more than that by stopping early. Points the
+    cardioid and bulb checks settle start from their cycle in closed form.
+*/
+static const double INTERIOR_PERIOD_TOLERANCE2 = 1e-10;
+static const int INTERIOR_MAX_PERIOD = 4096;
+static const int INTERIOR_NEWTON_STEPS = 8;
+
+// Principal square root of x + iy
+inline Complex ComplexSqrt(double x, double y) {
+  double r = sqrt(x * x + y * y);
+  return {sqrt(0.5 * (r + x)), std::copysign(sqrt(0.5 * (r - x)), y)};
+}
+
+// Distance to the boundary for c with an attracting cycle of the given
+// period near z, 0 when the cycle can't be resolved
+inline float CycleDistance(double zx, double zy, double cx, double cy,
+                           int period) {
+  // Newton: z -= (f^p(z) - z) / (dz - 1)
+  for (int step = 0; step < INTERIOR_NEWTON_STEPS; step++) {
+    double fx = zx, fy = zy, dx = 1, dy = 0;
+    for (int k = 0; k < period; k++) {
+      double t = 2 * (fx * dx - fy * dy);
+      dy = 2 * (fx * dy + fy * dx);
+      dx = t;
+      t = fx * fx - fy * fy + cx;
+      fy = 2 * fx * fy + cy;
+      fx = t;
+    }
+    double gx = fx - zx, gy = fy - zy;
+    double hx = dx - 1, hy = dy;
+    double h2 = hx * hx + hy * hy;
+    if (!(h2 > 0.0))
+      return 0.0f;
+    double stepX = (gx * hx + gy * hy) / h2;
+    double stepY = (gy * hx - gx * hy) / h2;
+    zx -= stepX;
+    zy -= stepY;
+    if (stepX * stepX + stepY * stepY < 1e-30)
+      break;
+  }
+
+  // Derivatives of f^p at the cycle, each updated from the old values
+  double x0 = zx, y0 = zy;
+  double dzX = 1, dzY = 0, dcX = 0, dcY = 0;
+  double dzdzX = 0, dzdzY = 0, dcdzX = 0, dcdzY = 0;
+  for (int k = 0; k < period; k++) {
+    // dcdz = 2 * (z * dcdz + dc * dz)
+    double ax = 2 * (x0 * dcdzX - y0 * dcdzY + dcX * dzX - dcY * dzY);
+    double ay = 2 * (x0 * dcdzY + y0 * dcdzX + dcX * dzY + dcY * dzX);
+    // dzdz = 2 * (dz^2 + z * dzdz)
+    double bx = 2 * (dzX * dzX - dzY * dzY + x0 * dzdzX - y0 * dzdzY);
+    double by = 2 * (2 * dzX * dzY + x0 * dzdzY + y0 * dzdzX);
+    // dc = 2 * z * dc + 1, dz = 2 * z * dz
+    double cX = 2 * (x0 * dcX - y0 * dcY) + 1;
+    double cY = 2 * (x0 * dcY + y0 * dcX);
+    double zX = 2 * (x0 * dzX - y0 * dzY);
+    double zY = 2 * (x0 * dzY + y0 * dzX);
+    dcdzX = ax, dcdzY = ay, dzdzX = bx, dzdzY = by;
+    dcX = cX, dcY = cY, dzX = zX, dzY = zY;
+    double t = x0 * x0 - y0 * y0 + cx;
+    y0 = 2 * x0 * y0 + cy;
+    x0 = t;
+  }
+
+  double multiplier2 = dzX * dzX + dzY * dzY;
+  if (!(multiplier2 < 1.0))
+    return 0.0f;
+  // dzdz * dc / (1 - dz)
+  double px = dzdzX * dcX - dzdzY * dcY;
+  double py = dzdzX * dcY + dzdzY * dcX;
+  double qx = 1 - dzX, qy = -dzY;
+  double q2 = qx * qx + qy * qy;
+  double denX = dcdzX + (px * qx + py * qy) / q2;
+  double denY = dcdzY + (py * qx - px * qy) / q2;
+  double den2 = denX * denX + denY * denY;
+  if (!(den2 > 0.0) || den2 > 1e300)
+    return 0.0f;
+  return (float)((1.0 - multiplier2) / sqrt(den2));
+}
+
+// Same for an orbit interior detection stopped at z after n steps
+inline float InteriorDistance(double zx, double zy, double cx, double cy,
+                              int n) {
+  int maxPeriod = std::min(n, INTERIOR_MAX_PERIOD);
+  double x = zx, y = zy;
+  for (int k = 1; k <= maxPeriod; k++) {
+    double t = x * x - y * y + cx;
+    y = 2 * x * y + cy;
+    x = t;
+    double ex = x - zx, ey = y - zy;
+    if (ex * ex + ey * ey < INTERIOR_PERIOD_TOLERANCE2)
+      return CycleDistance(zx, zy, cx, cy, k);
+  }
+  return 0.0f;
+}
+
+// Same inside the main cardioid (period 1) or the period-2 bulb
+inline float SettledInteriorDistance(double cx, double cy, bool cardioid) {
+  if (cardioid) {
+    // Fixed point z = (1 - sqrt(1 - 4c)) / 2
+    Complex root = ComplexSqrt(1 - 4 * cx, -4 * cy);
+    return CycleDistance(0.5 * (1 - root.real), -0.5 * root.imag, cx, cy, 1);
+  }
+  // 2-cycle z^2 + z + c + 1 = 0, z = (-1 + sqrt(-3 - 4c)) / 2
+  Complex root = ComplexSqrt(-3 - 4 * cx, -4 * cy);
+  return CycleDistance(0.5 * (root.real - 1), 0.5 * root.imag, cx, cy, 2);
+}
+
+// Escape count like mandelbrotEscape, plus smooth count and distance
+inline int mandelbrotEscapeDistance(double cx, double cy, int max_iter,
+                                    float *smooth, float *distance) {
+  double q = (cx - 0.25) * (cx - 0.25) + cy * cy;
+  bool cardioid = q * (q + (cx - 0.25)) < 0.25 * cy * cy;
+  if (cardioid || (cx + 1) * (cx + 1) + cy * cy < 0.0625) {
+    if (cardioid) {
+      COUNT_EVENT(cardioid, 1);
+    } else {
+      COUNT_EVENT(bulb, 1);
+    }
+    *smooth = (float)max_iter;
+    *distance = SettledInteriorDistance(cx, cy, cardioid);
+    return max_iter;
+  }
+  if (cx * cx + cy * cy > 4.0) {
+    COUNT_EVENT(radius, 1);
+    // z_1 = c and dz_1 = 1 are already past the bailout
+    *smooth = SmoothIterationCount(cx, cy, cx, cy, 1);
+    *distance = DistanceFromEscaped(cx, cy, 1.0, 0.0, cx, cy);
+    return 0;
+  }
+
+  double zx = 0, zy = 0, dx = 0, dy = 0;
+  double zx2, zy2;
+  double derX = 1, derY = 0, der2;
+  double refX = 0, refY = 0; // Interior detection, see above
+  int nextRef = INTERIOR_MIN_INTERVAL;
+  bool closed = false;
+  int n = 0;
+  do {
+    zx2 = zx * zx;
+    zy2 = zy * zy;
+    double ndx = 2 * (zx * dx - zy * dy) + 1;
+    dy = 2 * (zx * dy + zy * dx);
+    dx = ndx;
+    zy = 2 * zx * zy + cy;
+    zx = zx2 - zy2 + cx;
+    n++;
+    double t = 2 * (zx * derX - zy * derY);
+    derY = 2 * (zx * derY + zy * derX);
+    derX = t;
+    der2 = derX * derX + derY * derY;
+    if (der2 > INTERIOR_RESCALE2) {
+      derX = INTERIOR_RESCALE;
+      derY = 0;
+    }
+    double ex = zx - refX, ey = zy - refY;
+    closed = ex * ex + ey * ey < INTERIOR_CLOSE2 && der2 < 1.0;
+    if (n == nextRef) {
+      refX = zx;
+      refY = zy;
+      derX = 1;
+      derY = 0;
+      nextRef = NextInteriorReference(n);
+    }
+  } while (zx2 + zy2 <= 4.0 && n < max_iter && !closed);
+
+  COUNT_EVENT(iterations, n);
+  if (closed) {
+    COUNT_EVENT(interior, 1);
+    *smooth = (float)max_iter;
+    *distance = InteriorDistance(zx, zy, cx, cy, n);
+    n = max_iter;
+  } else if (n == max_iter) {
+    COUNT_EVENT(maxIter, 1);
+    *smooth = (float)max_iter;
+    *distance = 0.0f;
+  } else {
+    COUNT_EVENT(escaped, 1);
+    *smooth = SmoothIterationCount(zx, zy, cx, cy, n);
+    *distance = DistanceFromEscaped(zx, zy, dx, dy, cx, cy);
+  }
+  return n;
+}
+
+// DE_LANES points at once, results in out
+inline void mandelbrotDistanceLanes(const double *cx, const double *cy,
+                                    int maxIter, EscapeSample *out) {
+  double zx[DE_LANES] = {}, zy[DE_LANES] = {};
+  double dx[DE_LANES] = {}, dy[DE_LANES] = {};
+  double derX[DE_LANES], derY[DE_LANES] = {};
+  double refX[DE_LANES] = {}, refY[DE_LANES] = {}; // Interior detection
+  int closed[DE_LANES] = {};
+  int n[DE_LANES] = {};
+  int active[DE_LANES];
+  int anyActive = 0;
+  int steps = 0, nextRef = INTERIOR_MIN_INTERVAL;
+
+  // Points the early checks settle go through the scalar kernel
+  for (int l = 0; l < DE_LANES; l++) {
+    double q = (cx[l] - 0.25) * (cx[l] - 0.25) + cy[l] * cy[l];
+    bool settled = q * (q + (cx[l] - 0.25)) < 0.25 * cy[l] * cy[l] ||
+                   (cx[l] + 1) * (cx[l] + 1) + cy[l] * cy[l] < 0.0625 ||
+                   cx[l] * cx[l] + cy[l] * cy[l] > 4.0;
+    active[l] = !settled;
+    anyActive |= active[l];
+    derX[l] = 1;
+    if (settled) {
+      int count = mandelbrotEscapeDistance(cx[l], cy[l], maxIter,
+                                           &out[l].smooth, &out[l].distance);
+      out[l].iterations = (uint32_t)count;
+    }
+  }
+
+  // Lock-step iteration, finished lanes keep their values
+  while (anyActive) {
+    anyActive = 0;
+    for (int l = 0; l < DE_LANES; l++) {
+      double x = zx[l], y = zy[l];
+      double x2 = x * x, y2 = y * y;
+      double ndx = 2 * (x * dx[l] - y * dy[l]) + 1;
+      double ndy = 2 * (x * dy[l] + y * dx[l]);
+      bool step = active[l];
+      zx[l] = step ? x2 - y2 + cx[l] : x;
+      zy[l] = step ? 2 * x * y + cy[l] : y;
+      dx[l] = step ? ndx : dx[l];
+      dy[l] = step ? ndy : dy[l];
+      n[l] += active[l];
+      double t = 2 * (zx[l] * derX[l] - zy[l] * derY[l]);
+      double u = 2 * (zx[l] * derY[l] + zy[l] * derX[l]);
+      double d2 = t * t + u * u;
+      bool rescale = d2 > INTERIOR_RESCALE2;
+      double ex = zx[l] - refX[l], ey = zy[l] - refY[l];
+      bool close = (ex * ex + ey * ey < INTERIOR_CLOSE2) & (d2 < 1.0);
+      derX[l] = !step ? derX[l] : rescale ? INTERIOR_RESCALE : t;
+      derY[l] = !step ? derY[l] : rescale ? 0.0 : u;
+      closed[l] = step ? close : closed[l];
+      active[l] = active[l] & (x2 + y2 <= 4.0) & (n[l] < maxIter) & !close;
+      anyActive |= active[l];
+    }
+    // Interior detection: move the reference points
+    if (++steps == nextRef) {
+      for (int l = 0; l < DE_LANES; l++) {
+        refX[l] = zx[l];
+        refY[l] = zy[l];
+        derX[l] = 1;
+        derY[l] = 0;
+      }
+      nextRef = NextInteriorReference(steps);
+    }
+  }
+
+  for (int l = 0; l < DE_LANES; l++) {
+    if (n[l] == 0)
+      continue; // Settled above
+    COUNT_EVENT(iterations, n[l]);
+    out[l].iterations = (uint32_t)n[l];
+    if (closed[l]) {
+      COUNT_EVENT(interior, 1);
+      out[l].iterations = (uint32_t)maxIter;
+      out[l].smooth = (float)maxIter;
+      out[l].distance = InteriorDistance(zx[l], zy[l], cx[l], cy[l], n[l]);
+    } else if (n[l] == maxIter) {
+      COUNT_EVENT(maxIter, 1);
+      out[l].smooth = (float)maxIter;
+      out[l].distance = 0.0f;
+    } else {
+      COUNT_EVENT(escaped, 1);
+      out[l].smooth = SmoothIterationCount(zx[l], zy[l], cx[l], cy[l], n[l]);
+      out[l].distance =
+          DistanceFromEscaped(zx[l], zy[l], dx[l], dy[l], cx[l], cy[l]);
+    }
+  }
+}
+
+/*
+    Double-double arithmetic
+
+    Past DOUBLE_MIN_SPACING neighbouring pixels differ in the last bits of
+    a double, so the orbit is iterated in double-double instead: the
+    unevaluated sum hi + lo of two doubles, about 106 bits of mantissa,
+    which carries zooms down to widths of about 1e-30. Sums and products
+    are built from error-free transforms: TwoSum recovers the rounding
+    error of a + b exactly, TwoProd that of a * b with a single fused
+    multiply-add. That costs about ten times a double step.
+
+    The transforms rely on every operation being rounded exactly as
+    written, which -ffast-math doesn't promise (it may simplify
+    (a + b) - a to b), so this section is compiled without it.
+*/
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC push_options
+#pragma GCC optimize("no-fast-math")
+#endif
+
+struct DoubleDouble {
+  double hi, lo;
+};
+
+inline DoubleDouble TwoSum(double a, double b) {
+  double s = a + b;
+  double bb = s - a;
+  return {s, (a - (s - bb)) + (b - bb)};
+}
+
+// TwoSum for |a| >= |b|
+inline DoubleDouble FastTwoSum(double a, double b) {
+  double s = a + b;
+  return {s, b - (s - a)};
+}
+
+inline DoubleDouble TwoProd(double a, double b) {
+  double p = a * b;
+  return {p, std::fma(a, b, -p)};
+}
+
+inline DoubleDouble DDAdd(DoubleDouble a, DoubleDouble b) {
+  DoubleDouble s = TwoSum(a.hi, b.hi);
+  DoubleDouble t = TwoSum(a.lo, b.lo);
+  s = FastTwoSum(s.hi, s.lo + t.hi);
+  return FastTwoSum(s.hi, s.lo + t.lo);
+}
+
+inline DoubleDouble DDAdd(DoubleDouble a, double b) {
+  DoubleDouble s = TwoSum(a.hi, b);
+  return FastTwoSum(s.hi, s.lo + a.lo);
+}
+
+inline DoubleDouble DDSub(DoubleDouble a, DoubleDouble b) {
+  return DDAdd(a, {-b.hi, -b.lo});
+}
+
+inline DoubleDouble DDMul(DoubleDouble a, DoubleDouble b) {
+  DoubleDouble p = TwoProd(a.hi, b.hi);
+  return FastTwoSum(p.hi, p.lo + (a.hi * b.lo + a.lo * b.hi));
+}
+
+inline DoubleDouble DDMul(DoubleDouble a, double b) {
+  DoubleDouble p = TwoProd(a.hi, b);
+  return FastTwoSum(p.hi, p.lo + a.lo * b);
+}
+
+inline DoubleDouble DDSqr(DoubleDouble a) {
+  DoubleDouble p = TwoProd(a.hi, a.hi);
+  return FastTwoSum(p.hi, p.lo + 2 * a.hi * a.lo);
+}
+
+inline DoubleDouble DDDiv(DoubleDouble a, double b) {
+  double q = a.hi / b;
+  DoubleDouble r = DDSub(a, TwoProd(q, b));
+  return FastTwoSum(q, r.hi / b);
+}
+
+// Decimal number to double-double, so coordinates given with more digits
+// than a double holds keep them. Reads like strtod as far as it goes.
+DoubleDouble ParseDoubleDouble(const char *text) {
+  const char *p = text;
+  while (isspace((unsigned char)*p))
+    p++;
+  bool negative = *p == '-';
+  if (*p == '-' || *p == '+')
+    p++;
+
+  DoubleDouble value = {0.0, 0.0};
+  int exponent = 0;
+  bool point = false;
+  for (; isdigit((unsigned char)*p) || (*p == '.' && !point); p++) {
+    if (*p == '.') {
+      point = true;
+      continue;
+    }
+    value = DDAdd(DDMul(value, 10.0), (double)(*p - '0'));
+    exponent -= point;
+  }
+  if (*p == 'e' || *p == 'E')
+    exponent += atoi(p + 1);
+
+  // 10^22 is the largest power of ten a double holds exactly
+  for (; exponent > 0; exponent -= std::min(exponent, 22))
+    value = DDMul(value, pow(10.0, std::min(exponent, 22)));
+  for (; exponent < 0; exponent += std::min(-exponent, 22))
+    value = DDDiv(value, pow(10.0, std::min(-exponent, 22)));
+  return negative ? DoubleDouble{-value.hi, -value.lo} : value;
+}
+
+/*
+    Double-double kernels
+
+    mandelbrotEscapeDD is mandelbrotEscape (and, given distance,
+    mandelbrotEscapeDistance) with c and z in double-double. Only z needs
+    the extra precision: the early checks, the bailout test, interior
+    detection and the derivative for the distance estimate use the high
+    parts, and once the orbit has escaped it is finished in double.
+
+    mandelbrotDoubleDoubleLanes runs DD_LANES points in lock step like the
+    other lane kernels; the transforms are branch-free, so the whole step
+    vectorizes.
+
+    Both take the formula as template parameter like the other kernels.
+    Its Step is written for plain numbers, so StepDD repeats each one in
+    double-double, picked by overloading on the formula type. The
+    derivative is in double, but Formula::Derivative can't be inlined
+    across the fast-math boundary, so DerivativeDD repeats that as well.
+*/
+static const int DD_LANES = 4;
+
+// One Formula::Step in double-double, sx and sy are zx^2 and zy^2
+inline void StepDD(Mandelbrot, DoubleDouble &zx, DoubleDouble &zy,
+                   DoubleDouble sx, DoubleDouble sy, DoubleDouble cx,
+                   DoubleDouble cy) {
+  DoubleDouble p = DDMul(zx, zy);
+  zy = DDAdd({2 * p.hi, 2 * p.lo}, cy);
+  zx = DDAdd(DDSub(sx, sy), cx);
+}
+
+template <int Power>
+inline void StepDD(Multibrot<Power>, DoubleDouble &zx, DoubleDouble &zy,
+                   DoubleDouble sx, DoubleDouble sy, DoubleDouble cx,
+                   DoubleDouble cy) {
+  DoubleDouble p = DDMul(zx, zy);
+  DoubleDouble px = DDSub(sx, sy), py = {2 * p.hi, 2 * p.lo};
+  for (int k = 2; k < Power; k++) {
+    DoubleDouble t = DDSub(DDMul(px, zx), DDMul(py, zy));
+    py = DDAdd(DDMul(px, zy), DDMul(py, zx));
+    px = t;
+  }
+  zx = DDAdd(px, cx);
+  zy = DDAdd(py, cy);
+}
+
+inline void StepDD(BurningShip, DoubleDouble &zx, DoubleDouble &zy,
+                   DoubleDouble sx, DoubleDouble sy, DoubleDouble cx,
+                   DoubleDouble cy) {
+  DoubleDouble p = DDMul(zx, zy);
+  double sign = p.hi < 0.0 ? -2.0 : 2.0; // 2|p|, p has the sign of p.hi
+  zy = DDAdd({sign * p.hi, sign * p.lo}, cy);
+  zx = DDAdd(DDSub(sx, sy), cx);
+}
+
+inline void StepDD(Tricorn, DoubleDouble &zx, DoubleDouble &zy,
+                   DoubleDouble sx, DoubleDouble sy, DoubleDouble cx,
+                   DoubleDouble cy) {
+  DoubleDouble p = DDMul(zx, zy);
+  zy = DDAdd({-2 * p.hi, -2 * p.lo}, cy);
+  zx = DDAdd(DDSub(sx, sy), cx);
+}
+
+// Formula::Derivative compiled in this section
+inline void DerivativeDD(Mandelbrot, double zx, double zy, double &derX,
+                         double &derY) {
+  double t = 2 * (zx * derX - zy * derY);
+  derY = 2 * (zx * derY + zy * derX);
+  derX = t;
+}
+
+template <int Power>
+inline void DerivativeDD(Multibrot<Power>, double zx, double zy, double &derX,
+                         double &derY) {
+  double px = zx * zx - zy * zy, py = 2 * zx * zy;
+  for (int k = 2; k < Power - 1; k++) {
+    double t = px * zx - py * zy;
+    py = px * zy + py * zx;
+    px = t;
+  }
+  double t = Power * (px * derX - py * derY);
+  derY = Power * (px * derY + py * derX);
+  derX = t;
+}
+
+// a - b in double, exact to the last digits of a double-double when a and
+// b are close, for the interior detection's closing test
+inline double CloseDifferenceDD(DoubleDouble a, DoubleDouble b) {
+  return (a.hi - b.hi) + (a.lo - b.lo);
+}
+
+// Julia sets keep their c in double, only z_0 needs the extra digits
+template <typename Formula, bool Julia = false>
+int mandelbrotEscapeDD(DoubleDouble cx, DoubleDouble cy, int max_iter,
+                       float *smooth, float *distance = nullptr,
+                       Complex julia = {0.0, 0.0}) {
+  DoubleDouble zx = {0.0, 0.0}, zy = {0.0, 0.0};
+  if constexpr (Julia) {
+    zx = cx;
+    zy = cy;
+    cx = {julia.real, 0.0};
+    cy = {julia.imag, 0.0};
+    if (zx.hi * zx.hi + zy.hi * zy.hi > 4.0) {
+      COUNT_EVENT(radius, 1);
+      if (smooth)
+        *smooth = SmoothIterationCount<Formula>(zx.hi, zy.hi, cx.hi, cy.hi, 0);
+      if (distance)
+        *distance = 0.0f;
+      return 0;
+    }
+  }
+  double x = cx.hi, y = cy.hi;
+  if constexpr (Formula::cardioidChecks && !Julia) {
+    double q = (x - 0.25) * (x - 0.25) + y * y;
+    bool cardioid = q * (q + (x - 0.25)) < 0.25 * y * y;
+    if (cardioid || (x + 1) * (x + 1) + y * y < 0.0625) {
+      if (cardioid) {
+        COUNT_EVENT(cardioid, 1);
+      } else {
+        COUNT_EVENT(bulb, 1);
+      }
+      if (smooth)
+        *smooth = (float)max_iter;
+      if (distance)
+        *distance = SettledInteriorDistance(x, y, cardioid);
+      return max_iter;
+    }
+  }
+  if (!Julia && x * x + y * y > 4.0) {
+    COUNT_EVENT(radius, 1);
+    if (smooth)
+      *smooth = SmoothIterationCount<Formula>(x, y, x, y, 1);
+    if (distance)
+      *distance = Formula::distanceEstimation
+                      ? DistanceFromEscaped(x, y, 1.0, 0.0, x, y)
+                      : 0.0f;
+    return 0;
+  }
+
+  double zx2, zy2;
+  double dx = 0, dy = 0;
+  double derX = 1, derY = 0, der2 = 1;
+  DoubleDouble refX = zx, refY = zy; // Interior detection
+  int nextRef = INTERIOR_MIN_INTERVAL;
+  bool closed = false;
+  int n = 0;
+  do {
+    DoubleDouble sx = DDSqr(zx), sy = DDSqr(zy);
+    zx2 = sx.hi;
+    zy2 = sy.hi;
+    if constexpr (Formula::distanceEstimation && !Julia) {
+      double ndx = 2 * (zx.hi * dx - zy.hi * dy) + 1;
+      dy = 2 * (zx.hi * dy + zy.hi * dx);
+      dx = ndx;
+    }
+    StepDD(Formula(), zx, zy, sx, sy, cx, cy);
+    n++;
+    if constexpr (Formula::interiorDetection) {
+      DerivativeDD(Formula(), zx.hi, zy.hi, derX, derY);
+      der2 = derX * derX + derY * derY;
+      if (der2 > INTERIOR_RESCALE2) {
+        derX = INTERIOR_RESCALE;
+        derY = 0;
+      }
+      double ex = CloseDifferenceDD(zx, refX), ey = CloseDifferenceDD(zy, refY);
+      closed = ex * ex + ey * ey < INTERIOR_CLOSE2_DD && der2 < 1.0;
+      if (n == nextRef) {
+        refX = zx;
+        refY = zy;
+        derX = 1;
+        derY = 0;
+        nextRef = NextInteriorReference(n);
+      }
+    }
+  } while (zx2 + zy2 <= 4.0 && n < max_iter && !closed);
+
+  COUNT_EVENT(iterations, n);
+  float mu = (float)max_iter, estimate = 0.0f;
+  if (closed) {
+    COUNT_EVENT(interior, 1);
+    if (distance && Formula::distanceEstimation && !Julia)
+      estimate = InteriorDistance(zx.hi, zy.hi, x, y, n);
+    n = max_iter;
+  } else if (n == max_iter) {
+    COUNT_EVENT(maxIter, 1);
+  } else {
+    COUNT_EVENT(escaped, 1);
+    if (smooth)
+      mu = SmoothIterationCount<Formula>(zx.hi, zy.hi, x, y, n);
+    if (distance && Formula::distanceEstimation && !Julia)
+      estimate = DistanceFromEscaped(zx.hi, zy.hi, dx, dy, x, y);
+  }
+  if (smooth)
+    *smooth = mu;
+  if (distance)
+    *distance = estimate;
+  return n;
+}
+
+// DD_LANES points at once, results in out. The smooth count is only
+// computed when wantSmooth is set.
+template <typename Formula, bool Julia = false>
+void mandelbrotDoubleDoubleLanes(const DoubleDouble *cx, const DoubleDouble *cy,
+                                 int maxIter, bool wantSmooth,
+                                 EscapeSample *out,
+                                 Complex julia = {0.0, 0.0}) {
+  double zxHi[DD_LANES] = {}, zxLo[DD_LANES] = {};
+  double zyHi[DD_LANES] = {}, zyLo[DD_LANES] = {};
+  double derX[DD_LANES], derY[DD_LANES] = {};
+  DoubleDouble refX[DD_LANES], refY[DD_LANES]; // Interior detection
+  int closed[DD_LANES] = {};
+  int n[DD_LANES] = {};
+  int active[DD_LANES];
+  int anyActive = 0;
+  int steps = 0, nextRef = INTERIOR_MIN_INTERVAL;
+
+  // Points the early checks settle go through the scalar kernel
+  for (int l = 0; l < DD_LANES; l++) {
+    double x = cx[l].hi, y = cy[l].hi;
+    bool settled = x * x + y * y > 4.0;
+    if constexpr (Formula::cardioidChecks && !Julia) {
+      double q = (x - 0.25) * (x - 0.25) + y * y;
+      settled = settled || q * (q + (x - 0.25)) < 0.25 * y * y ||
+                (x + 1) * (x + 1) + y * y < 0.0625;
+    }
+    if constexpr (Julia) {
+      zxHi[l] = cx[l].hi;
+      zxLo[l] = cx[l].lo;
+      zyHi[l] = cy[l].hi;
+      zyLo[l] = cy[l].lo;
+    }
+    derX[l] = 1;
+    refX[l] = {zxHi[l], zxLo[l]};
+    refY[l] = {zyHi[l], zyLo[l]};
+    active[l] = !settled;
+    anyActive |= active[l];
+    if (settled) {
+      out[l].smooth = 0.0f;
+      out[l].iterations = (uint32_t)mandelbrotEscapeDD<Formula, Julia>(
+          cx[l], cy[l], maxIter, wantSmooth ? &out[l].smooth : nullptr,
+          nullptr, julia);
+      out[l].distance = 0.0f;
+    }
+  }
+
+  // Lock-step iteration, finished lanes keep their values
+  DoubleDouble juliaRe = {julia.real, 0.0}, juliaIm = {julia.imag, 0.0};
+  while (anyActive) {
+    anyActive = 0;
+    for (int l = 0; l < DD_LANES; l++) {
+      DoubleDouble x = {zxHi[l], zxLo[l]}, y = {zyHi[l], zyLo[l]};
+      DoubleDouble sx = DDSqr(x), sy = DDSqr(y);
+      DoubleDouble nx = x, ny = y;
+      StepDD(Formula(), nx, ny, sx, sy, Julia ? juliaRe : cx[l],
+             Julia ? juliaIm : cy[l]);
+      double t = derX[l], u = derY[l], d2 = 2.0;
+      if constexpr (Formula::interiorDetection) {
+        DerivativeDD(Formula(), nx.hi, ny.hi, t, u);
+        d2 = t * t + u * u;
+      }
+      bool rescale = d2 > INTERIOR_RESCALE2;
+      double ex = CloseDifferenceDD(nx, refX[l]);
+      double ey = CloseDifferenceDD(ny, refY[l]);
+      bool close = (ex * ex + ey * ey < INTERIOR_CLOSE2_DD) & (d2 < 1.0);
+      bool step = active[l];
+      zxHi[l] = step ? nx.hi : x.hi;
+      zxLo[l] = step ? nx.lo : x.lo;
+      zyHi[l] = step ? ny.hi : y.hi;
+      zyLo[l] = step ? ny.lo : y.lo;
+      derX[l] = !step ? derX[l] : rescale ? INTERIOR_RESCALE : t;
+      derY[l] = !step ? derY[l] : rescale ? 0.0 : u;
+      closed[l] = step ? close : closed[l];
+      n[l] += active[l];
+      active[l] = active[l] & (sx.hi + sy.hi <= 4.0) & (n[l] < maxIter) &
+                  !close;
+      anyActive |= active[l];
+    }
+    // Interior detection: move the reference points
+    if (++steps == nextRef) {
+      for (int l = 0; l < DD_LANES; l++) {
+        refX[l] = {zxHi[l], zxLo[l]};
+        refY[l] = {zyHi[l], zyLo[l]};
+        derX[l] = 1;
+        derY[l] = 0;
+      }
+      nextRef = NextInteriorReference(steps);
+    }
+  }
+
+  for (int l = 0; l < DD_LANES; l++) {
+    if (n[l] == 0)
+      continue; // Settled above
+    COUNT_EVENT(iterations, n[l]);
+    out[l].iterations = (uint32_t)n[l];
+    out[l].smooth = (float)maxIter;
+    out[l].distance = 0.0f;
+    if (closed[l]) {
+      COUNT_EVENT(interior, 1);
+      out[l].iterations = (uint32_t)maxIter;
+    } else if (n[l] == maxIter) {
+      COUNT_EVENT(maxIter, 1);
+    } else {
+      COUNT_EVENT(escaped, 1);
+      out[l].smooth =
+          wantSmooth ? SmoothIterationCount<Formula>(
+                           zxHi[l], zyHi[l], Julia ? julia.real : cx[l].hi,
+                           Julia ? julia.imag : cy[l].hi, n[l])
+                     : 0.0f;
+    }
+  }
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC pop_options
+#endif
+
+/*
+    Formula registry
+
+    The kernel instances of every formula, indexed by the FORMULA_* id
+    that views, tile keys and iteration files carry, and in
+    JULIA_FORMULAS the same for the Julia sets of the formula. A new
+    formula is a struct (and StepDD) above plus one entry in each.
+*/
+enum FormulaId {
+  FORMULA_MANDELBROT,
+  FORMULA_MULTIBROT3,
+  FORMULA_MULTIBROT4,
+  FORMULA_MULTIBROT5,
+  FORMULA_BURNING_SHIP,
+  FORMULA_TRICORN,
+  FORMULA_COUNT
+};
+
+// The kernels all take the c of Julia sets last, see Julia sets
+struct FormulaKernels {
+  const char *name;
+  // Scalar kernel per KernelPrecision, float and double
+  int (*escape[2])(double cx, double cy, int maxIter, float *smooth,
+                   Complex julia);
+  void (*floatLanes)(const double *cx, const double *cy, int maxIter,
+                     bool wantSmooth, EscapeSample *out, Complex julia);
+  int (*escapeDD)(DoubleDouble cx, DoubleDouble cy, int maxIter,
+                  float *smooth, float *distance, Complex julia);
+  void (*doubleDoubleLanes)(const DoubleDouble *cx, const DoubleDouble *cy,
+                            int maxIter, bool wantSmooth, EscapeSample *out,
+                            Complex julia);
+  bool distance; // Has distance estimates, see mandelbrotEscapeDistance
+  // A Julia set with f(-z) = f(z), which makes it symmetric about 0
+  bool pointSymmetric;
+};
+
+template <typename Formula, bool Julia = false>
+constexpr FormulaKernels FormulaEntry(const char *name) {
+  return {name,
+          {mandelbrotEscapeIn<float, Formula, Julia>,
+           mandelbrotEscapeIn<double, Formula, Julia>},
+          mandelbrotFloatLanes<Formula, Julia>,
+          mandelbrotEscapeDD<Formula, Julia>,
+          mandelbrotDoubleDoubleLanes<Formula, Julia>,
+          Formula::distanceEstimation && !Julia,
+          Julia && Formula::power % 2 == 0};
+}
+
+static const FormulaKernels FORMULAS[FORMULA_COUNT] = {
+    FormulaEntry<Mandelbrot>("mandelbrot"),
+    FormulaEntry<Multibrot<3>>("multibrot3"),
+    FormulaEntry<Multibrot<4>>("multibrot4"),
+    FormulaEntry<Multibrot<5>>("multibrot5"),
+    FormulaEntry<BurningShip>("burningship"),
+    FormulaEntry<Tricorn>("tricorn")};
+
+static const FormulaKernels JULIA_FORMULAS[FORMULA_COUNT] = {
+    FormulaEntry<Mandelbrot, true>("mandelbrot"),
+    FormulaEntry<Multibrot<3>, true>("multibrot3"),
+    FormulaEntry<Multibrot<4>, true>("multibrot4"),
+    FormulaEntry<Multibrot<5>, true>("multibrot5"),
+    FormulaEntry<BurningShip, true>("burningship"),
+    FormulaEntry<Tricorn, true>("tricorn")};
+
+// FORMULA_* id of the formula called name, -1 if there is none
+inline int FindFormula(const char *name) {
+  for (int id = 0; id < FORMULA_COUNT; id++)
+    if (strcmp(FORMULAS[id].name, name) == 0)
+      return id;
+  return -1;
+}
+
+/*
+    Iteration data files (.fxi)
+
+    Stores the raw EscapeSample data of a render so it can be recolored,
+    cropped or analysed later without running mandelbrotEscape again. All
+    values are little-endian.
+
+    Header, FXI_HEADER_SIZE (128) bytes:
+        char     magic[8]      "FXITER1" plus a zero byte
+        uint32   version       2 (1 had a coarser smooth channel)
+        uint32   headerSize    128, data starts here
+        uint32   width, height image size in pixels
+        uint32   tileSize      TILE_SIZE, readers reject other sizes
+        uint32   channels      FXI_CHANNEL_* bits present in each tile
+        uint32   maxIter
+        uint32   formula       FORMULA_* id, 0 (Mandelbrot) in older files,
+                               plus FXI_FORMULA_JULIA for a Julia set
+        double   reMin, reMax, imMin, imMax   view bounds
+        double   juliaRe, juliaIm   c of the Julia set, else 0
+        zero padding up to headerSize
+
+    Data: one chunk per renderer tile, tiles in row-major order. Every
+    chunk covers a full tileSize x tileSize block, edge tiles are padded,
+    so chunk k starts at headerSize + k * chunkBytes with no index needed.
+    Inside a chunk the channels are stored planar in bit order: uint32
+    iterations, then float32 smooth, then float32 distance, each as
+    tileSize * tileSize values in row-major order.
+
+    The reader maps the file into memory, so cropping a corner of a huge
+    render only pages in the tiles it touches.
+*/
+static const char FXI_MAGIC[8] = {'F', 'X', 'I', 'T', 'E', 'R', '1', 0};
+static const uint32_t FXI_VERSION = 2;
+static const uint32_t FXI_HEADER_SIZE = 128;
+static const uint32_t FXI_CHANNEL_ITERATIONS = 1;
+static const uint32_t FXI_CHANNEL_SMOOTH = 2;
+static const uint32_t FXI_CHANNEL_DISTANCE = 4;
+static const uint32_t FXI_FORMULA_JULIA = 0x100;
+
+struct FxiHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;
+  uint32_t width, height;
+  uint32_t tileSize;
+  uint32_t channels;
+  uint32_t maxIter;
+  uint32_t formula;
+  double reMin, reMax, imMin, imMax;
+  double juliaRe, juliaIm;
+};
+static_assert(sizeof(FxiHeader) <= FXI_HEADER_SIZE, "header too large");
+
+inline int FxiChannelCount(uint32_t channels) {
+  return ((channels & FXI_CHANNEL_ITERATIONS) ? 1 : 0) +
+         ((channels & FXI_CHANNEL_SMOOTH) ? 1 : 0) +
+         ((channels & FXI_CHANNEL_DISTANCE) ? 1 : 0);
+}
+
+// All channels are 4 bytes per pixel
+inline size_t FxiChunkBytes(const FxiHeader &h) {
+  return (size_t)h.tileSize * h.tileSize * 4 * FxiChannelCount(h.channels);
+}
+
+/*
+    Simple:
+        We want to map left to right for the real part
+        and top to bottom for the imaginary part
+
+        So we have:
+            real = real_min + (x / width) * (real_max - real_min)
+            imag = imag_max - (y / height) * (imag_max - imag_min)
+
+        this is because the y axis is inverted
+        where the top left corner is at (0,0) and the
+        bottom left corner is (0, height)
+
+        so, we see that the imag_max is at the top and
+        the imag_min is at the bottom and the real_min is
+        at the left and the real_max is at the right
+
+*/
+
+// Draw ASCII art splash screen
+void DrawSplashScreen(int screenWidth, int screenHeight, double time) {
+  ClearBackground(BLACK);
+
+  // Simple blinking
+  float blink = sin(time * 3.0f);
+  if (blink > 0) {
+    const char *prompt = "Press ENTER or click to begin...";
+    // Center the text by screenWidth - textWidth / 2 and screenHeight / 2
+    DrawText(prompt, (screenWidth - MeasureText(prompt, 40)) / 2, screenHeight / 2, 40,
+             YELLOW);
+  }
+}
+
+// Map the number of iterations to a color
+inline Color IterationColor(int n, int maxIter) {
+  if (n == maxIter)
+    return BLACK;
+  int hue = (int)(255.0 * n / maxIter);
+  return ColorFromHSV(hue, 0.5f, 1.2f);
+}
+
+// Same palette, driven by the smooth iteration count so there are no bands
+inline Color SmoothIterationColor(int n, float smooth, int maxIter) {
+  if (n == maxIter)
+    return BLACK;
+  return ColorFromHSV(255.0f * smooth / maxIter, 0.5f, 1.2f);
+}
+
+// A view: output size in pixels, the complex plane rectangle it covers and
+// the iteration limit
+struct ViewRequest {
+  int width, height;
+  double Re_min, Re_max, Im_min, Im_max;
+  int maxIter = MAX_ITER;
+  int formula = FORMULA_MANDELBROT; // Index into FORMULAS
+  // The Julia set of juliaC instead, with the same formula
+  bool julia = false;
+  Complex juliaC = {0.0, 0.0};
+
+  // Optional pixel grid (spacingX > 0): pixel (x, y) is then exactly
+  //   real = (originX + x) * spacingX,  imag = -(originY + y) * spacingY
+  // so any two views with the same spacing agree on every shared pixel.
+  double spacingX = 0.0, spacingY = 0.0;
+  int64_t originX = 0, originY = 0;
+
+  // Views deeper than a double can place (see AnchoredView): Re_min ..
+  // Im_max are then offsets from this point, kept to full precision
+  DoubleDouble anchorRe = {0.0, 0.0}, anchorIm = {0.0, 0.0};
+
+  // Extra samples per edge pixel, 0 turns anti-aliasing off
+  int antialias = 0;
+  // Color by the smooth iteration count instead of the integer one
+  bool smoothColoring = false;
+  // Spread the palette by the iteration histogram of the view
+  bool histogramColoring = false;
+  // Darken pixels by their distance estimate to the set boundary
+  bool distanceShading = false;
+  // Color for every escape count 0 .. maxIter - 1, replaces the hue
+  // mapping when set (the equalized palette of histogram coloring)
+  std::shared_ptr<const std::vector<Color>> palette = nullptr;
+
+  bool OnGrid() const { return spacingX > 0.0; }
+};
+
+/*
+    Snaps a view onto the pixel grid of the given spacing: the top-left
+    pixel moves by less than half a pixel so it lands on a whole multiple
+    of the spacing. Past about 2^50 pixels from the origin the grid can't
+    be represented exactly any more and the view is returned off-grid.
+*/
+ViewRequest GridView(int width, int height, double spacingX, double spacingY,
+                     double Re_min, double Im_max, int maxIter) {
+  ViewRequest view = {width,
+                      height,
+                      Re_min,
+                      Re_min + width * spacingX,
+                      Im_max - height * spacingY,
+                      Im_max,
+                      maxIter};
+  double gx = Re_min / spacingX;
+  double gy = -Im_max / spacingY;
+  if (fabs(gx) > 0x1p50 || fabs(gy) > 0x1p50)
+    return view;
+
+  view.spacingX = spacingX;
+  view.spacingY = spacingY;
+  view.originX = (int64_t)llround(gx);
+  view.originY = (int64_t)llround(gy);
+  view.Re_min = view.originX * spacingX;
+  view.Re_max = (view.originX + width) * spacingX;
+  view.Im_max = -view.originY * spacingY;
+  view.Im_min = -(view.originY + height) * spacingY;
+  return view;
+}
+
+/*
+    For views deeper than double resolves, the top-left corner itself
+    needs more digits than a double holds. An anchored view keeps it in
+    double-double as its anchor and covers Re_min = 0 .. Re_max and
+    Im_min .. Im_max = 0 from there, so every pixel is the anchor plus a
+    small offset that keeps full precision however deep the view is.
+    Anchored views are off-grid and bypass the tile caches.
+*/
+ViewRequest AnchoredView(int width, int height, double spacingX,
+                         double spacingY, DoubleDouble Re_min,
+                         DoubleDouble Im_max, int maxIter) {
+  ViewRequest view = {
+      width, height, 0.0, width * spacingX, -height * spacingY, 0.0, maxIter};
+  view.anchorRe = Re_min;
+  view.anchorIm = Im_max;
+  return view;
+}
+
+// The view with the given top-left corner: on the grid where GridView can
+// place it, anchored where only double-double resolves its pixels
+ViewRequest PlaceView(int width, int height, double spacingX, double spacingY,
+                      DoubleDouble Re_min, DoubleDouble Im_max, int maxIter) {
+  ViewRequest view = GridView(width, height, spacingX, spacingY, Re_min.hi,
+                              Im_max.hi, maxIter);
+  if (view.OnGrid() || PrecisionForSpacing(std::min(spacingX, spacingY)) !=
+                           PRECISION_DOUBLE_DOUBLE)
+    return view;
+  return AnchoredView(width, height, spacingX, spacingY, Re_min, Im_max,
+                      maxIter);
+}
+
+// How far view a's anchor lies from view b's, to compare their offsets
+inline double AnchorShiftRe(const ViewRequest &a, const ViewRequest &b) {
+  return DDSub(a.anchorRe, b.anchorRe).hi;
+}
+
+inline double AnchorShiftIm(const ViewRequest &a, const ViewRequest &b) {
+  return DDSub(a.anchorIm, b.anchorIm).hi;
+}
+
+/*
+    Distance shading: escaped pixels closer to the boundary than
+    DE_SHADE_PIXELS fade toward black, so filaments far thinner than a
+    pixel still show as crisp dark lines instead of breaking up. Interior
+    pixels with an interior estimate are drawn in INTERIOR_SHADE and fade
+    the same way, which outlines every component from the inside too.
+*/
+static const double DE_SHADE_PIXELS = 1.5;
+static const Color INTERIOR_SHADE = {48, 40, 72, 255};
+
+inline Color DistanceShade(Color c, float distance, double pixelSize) {
+  double t = std::clamp(distance / (DE_SHADE_PIXELS * pixelSize), 0.0, 1.0);
+  double scale = sqrt(t);
+  return {(unsigned char)(c.r * scale), (unsigned char)(c.g * scale),
+          (unsigned char)(c.b * scale), c.a};
+}
+
+// Color of a pixel of view with escape count n, smooth count smooth and
+// distance estimate distance (only used with distance shading)
+inline Color ViewColor(const ViewRequest &view, int n, float smooth,
+                       float distance = 0.0f) {
+  Color color;
+  if (n >= view.maxIter && !(view.distanceShading && distance > 0.0f))
+    return BLACK;
+  if (n >= view.maxIter)
+    color = INTERIOR_SHADE;
+  else if (view.palette)
+    color = (*view.palette)[n];
+  else if (view.smoothColoring)
+    color = SmoothIterationColor(n, smooth, view.maxIter);
+  else
+    color = IterationColor(n, view.maxIter);
+
+  if (view.distanceShading)
+    color = DistanceShade(color, distance,
+                          (view.Re_max - view.Re_min) / view.width);
+  return color;
+}
+
+// Complex plane coordinates of pixel column x / row y of a view, relative
+// to its anchor if it has one
+inline double PixelReal(const ViewRequest &view, int x) {
+  if (view.OnGrid())
+    return (view.originX + x) * view.spacingX;
+  return view.Re_min + (x / (double)view.width) * (view.Re_max - view.Re_min);
+}
+
+inline double PixelImag(const ViewRequest &view, int y) {
+  if (view.OnGrid())
+    return -(view.originY + y) * view.spacingY;
+  return view.Im_max - (y / (double)view.height) * (view.Im_max - view.Im_min);
+}
+
+// The same in double-double and including the anchor, exact on the grid
+inline DoubleDouble PixelRealDD(const ViewRequest &view, int x) {
+  if (view.OnGrid())
+    return TwoProd((double)(view.originX + x), view.spacingX);
+  return DDAdd(view.anchorRe, PixelReal(view, x));
+}
+
+inline DoubleDouble PixelImagDD(const ViewRequest &view, int y) {
+  if (view.OnGrid())
+    return TwoProd(-(double)(view.originY + y), view.spacingY);
+  return DDAdd(view.anchorIm, PixelImag(view, y));
+}
+
+// Kernel precision for a view, by its finer pixel spacing
+inline KernelPrecision ViewPrecision(const ViewRequest &view) {
+  if (view.OnGrid())
+    return PrecisionForSpacing(std::min(view.spacingX, view.spacingY));
+  return PrecisionForSpacing(
+      std::min((view.Re_max - view.Re_min) / view.width,
+               (view.Im_max - view.Im_min) / view.height));
+}
+
+// The kernels a view iterates with
+inline const FormulaKernels &ViewKernels(const ViewRequest &view) {
+  return view.julia ? JULIA_FORMULAS[view.formula] : FORMULAS[view.formula];
+}
+
+// Escape data of pixels x0 .. x0 + count - 1 in row y of a view, with
+// the smooth count only if wantSmooth is set
+void ViewSampleRow(const ViewRequest &view, int x0, int y, int count,
+                   bool wantSmooth, EscapeSample *out) {
+  const FormulaKernels &kernels = ViewKernels(view);
+  KernelPrecision precision = ViewPrecision(view);
+  if (precision == PRECISION_DOUBLE_DOUBLE) {
+    DoubleDouble imag = PixelImagDD(view, y);
+    for (int i = 0; i < count; i += DD_LANES) {
+      DoubleDouble cx[DD_LANES], cy[DD_LANES];
+      EscapeSample lanes[DD_LANES];
+      for (int l = 0; l < DD_LANES; l++) {
+        cx[l] = PixelRealDD(view, x0 + i + l); // Past the end is unused
+        cy[l] = imag;
+      }
+      kernels.doubleDoubleLanes(cx, cy, view.maxIter, wantSmooth, lanes,
+                                view.juliaC);
+      std::copy(lanes, lanes + std::min(DD_LANES, count - i), out + i);
+    }
+    return;
+  }
+
+  double imag = PixelImag(view, y) + view.anchorIm.hi;
+  if (precision == PRECISION_FLOAT) {
+    for (int i = 0; i < count; i += FLOAT_LANES) {
+      double cx[FLOAT_LANES], cy[FLOAT_LANES];
+      EscapeSample lanes[FLOAT_LANES];
+      for (int l = 0; l < FLOAT_LANES; l++) {
+        cx[l] = PixelReal(view, x0 + i + l) + view.anchorRe.hi;
+        cy[l] = imag;
+      }
+      kernels.floatLanes(cx, cy, view.maxIter, wantSmooth, lanes,
+                         view.juliaC);
+      std::copy(lanes, lanes + std::min(FLOAT_LANES, count - i), out + i);
+    }
+    return;
+  }
+
+  for (int i = 0; i < count; i++) {
+    float smooth = 0.0f;
+    int n = kernels.escape[PRECISION_DOUBLE](
+        PixelReal(view, x0 + i) + view.anchorRe.hi, imag, view.maxIter,
+        wantSmooth ? &smooth : nullptr, view.juliaC);
+    out[i] = {(uint32_t)n, smooth, 0.0f};
+  }
+}
+
+// Same with the distance estimate, for distance shading (0 for formulas
+// without one)
+void ViewDistanceRow(const ViewRequest &view, int x0, int y, int count,
+                     EscapeSample *out) {
+  if (!ViewKernels(view).distance) {
+    ViewSampleRow(view, x0, y, count, true, out);
+    return;
+  }
+  if (ViewPrecision(view) == PRECISION_DOUBLE_DOUBLE) {
+    DoubleDouble imag = PixelImagDD(view, y);
+    for (int i = 0; i < count; i++) {
+      EscapeSample &sample = out[i];
+      sample.iterations = (uint32_t)mandelbrotEscapeDD<Mandelbrot>(
+          PixelRealDD(view, x0 + i), imag, view.maxIter, &sample.smooth,
+          &sample.distance);
+    }
+    return;
+  }
+
+  // DE_LANES pixels at a time
+  double imag = PixelImag(view, y) + view.anchorIm.hi;
+  for (int i = 0; i < count; i += DE_LANES) {
+    double cx[DE_LANES], cy[DE_LANES];
+    EscapeSample lanes[DE_LANES];
+    for (int l = 0; l < DE_LANES; l++) {
+      cx[l] = PixelReal(view, x0 + i + l) + view.anchorRe.hi;
+      cy[l] = imag;
+    }
+    mandelbrotDistanceLanes(cx, cy, view.maxIter, lanes);
+    std::copy(lanes, lanes + std::min(DE_LANES, count - i), out + i);
+  }
+}
+
+// Escape data of the point u, v pixels right of and below the center of
+// pixel (x, y), with the distance estimate only if wantDistance is set
+// and the formula has one
+EscapeSample ViewPointSample(const ViewRequest &view, int x, int y, double u,
+                             double v, bool wantSmooth, bool wantDistance) {
+  double du = u * (view.Re_max - view.Re_min) / view.width;
+  double dv = v * (view.Im_max - view.Im_min) / view.height;
+  const FormulaKernels &kernels = ViewKernels(view);
+  KernelPrecision precision = ViewPrecision(view);
+  EscapeSample sample = {0, 0.0f, 0.0f};
+  wantDistance = wantDistance && kernels.distance;
+  float *smooth = wantSmooth || wantDistance ? &sample.smooth : nullptr;
+
+  if (precision == PRECISION_DOUBLE_DOUBLE) {
+    sample.iterations = (uint32_t)kernels.escapeDD(
+        DDAdd(PixelRealDD(view, x), du), DDAdd(PixelImagDD(view, y), -dv),
+        view.maxIter, smooth, wantDistance ? &sample.distance : nullptr,
+        view.juliaC);
+    return sample;
+  }
+
+  double real = PixelReal(view, x) + view.anchorRe.hi + du;
+  double imag = PixelImag(view, y) + view.anchorIm.hi - dv;
+  if (wantDistance)
+    sample.iterations = (uint32_t)mandelbrotEscapeDistance(
+        real, imag, view.maxIter, &sample.smooth, &sample.distance);
+  else
+    sample.iterations = (uint32_t)kernels.escape[precision](
+        real, imag, view.maxIter, smooth, view.juliaC);
+  return sample;
+}
+
+struct DirtyRect {
+  int x, y, width, height;
+};
+
+/*
+    Adaptive anti-aliasing
+
+    Aliasing only shows where the color changes sharply between pixels, at
+    the boundary of the set and between escape bands. So instead of
+    supersampling the whole frame, AntialiasRect finds the pixels of a
+    finished rectangle whose color differs from a 4-neighbour by more than
+    AA_THRESHOLD and averages view.antialias extra samples into just those.
+    Neighbours outside the rectangle are iterated on the spot, so a tile
+    can be smoothed on its own as soon as it is done, and a band or tile
+    comes out exactly as it would as part of a larger image.
+
+    With smooth coloring there are no band edges, only the set boundary
+    is sharp. Edge pixels whose distance estimate (exterior or interior)
+    puts them more than AA_BOUNDARY_PIXELS away from it then keep their
+    single sample.
+
+    Sample offsets follow the R2 low-discrepancy sequence, shifted per
+    pixel by a hash of its grid position. They are fully deterministic, so
+    the same pixel comes out the same in every render and from the cache.
+*/
+static const int AA_SAMPLES = 8;    // Default extra samples per edge pixel
+static const int AA_THRESHOLD = 48; // Sum of RGB differences that is an edge
+static const double AA_BOUNDARY_PIXELS = 2.0;
+
+inline int ColorDistance(Color a, Color b) {
+  return abs(a.r - b.r) + abs(a.g - b.g) + abs(a.b - b.b);
+}
+
+// Color at u, v pixels off pixel (x, y), see ViewPointSample
+inline Color ViewPixelColor(const ViewRequest &view, int x, int y,
+                            double u = 0.0, double v = 0.0) {
+  EscapeSample sample = ViewPointSample(
+      view, x, y, u, v, view.smoothColoring, view.distanceShading);
+  return ViewColor(view, (int)sample.iterations, sample.smooth,
+                   sample.distance);
+}
+
+void AntialiasRect(const ViewRequest &view, const DirtyRect &r,
+                   Color *pixelBuffer) {
+  // The rectangle with a one pixel border, which may lie outside the view
+  int w = r.width + 2, h = r.height + 2;
+  thread_local std::vector<Color> local;
+  thread_local std::vector<int> edges;
+  local.resize((size_t)w * h);
+  edges.clear();
+
+  for (int ly = 0; ly < h; ly++) {
+    int y = r.y + ly - 1;
+    bool borderRow = ly == 0 || ly == h - 1;
+    for (int lx = 0; lx < w; lx++) {
+      int x = r.x + lx - 1;
+      if (borderRow || lx == 0 || lx == w - 1) {
+        local[(size_t)ly * w + lx] = ViewPixelColor(view, x, y);
+      } else {
+        local[(size_t)ly * w + lx] = pixelBuffer[(size_t)y * view.width + x];
+      }
+    }
+  }
+
+  for (int ly = 1; ly < h - 1; ly++) {
+    for (int lx = 1; lx < w - 1; lx++) {
+      const Color *c = &local[(size_t)ly * w + lx];
+      int distance = std::max(
+          std::max(ColorDistance(*c, c[-1]), ColorDistance(*c, c[1])),
+          std::max(ColorDistance(*c, c[-w]), ColorDistance(*c, c[w])));
+      if (distance > AA_THRESHOLD)
+        edges.push_back(ly * w + lx);
+    }
+  }
+
+  double pixelRe = (view.Re_max - view.Re_min) / view.width;
+  bool boundaryOnly = view.smoothColoring && !view.palette;
+  int samples = view.antialias;
+  for (int index : edges) {
+    int x = r.x + index % w - 1;
+    int y = r.y + index / w - 1;
+
+    if (boundaryOnly && ViewPointSample(view, x, y, 0.0, 0.0, true, true)
+                                .distance > AA_BOUNDARY_PIXELS * pixelRe)
+      continue;
+
+    uint32_t gx = (uint32_t)(view.OnGrid() ? view.originX + x : x);
+    uint32_t gy = (uint32_t)(view.OnGrid() ? view.originY + y : y);
+    uint32_t hash = (gx * 73856093u) ^ (gy * 19349663u);
+    double shift = (hash >> 8) / 16777216.0;
+
+    Color center = local[index];
+    int sumR = center.r, sumG = center.g, sumB = center.b, sumA = center.a;
+    for (int s = 1; s <= samples; s++) {
+      double u = shift + s * 0.7548776662466927;
+      double v = shift + s * 0.5698402909980532;
+      u = u - floor(u) - 0.5;
+      v = v - floor(v) - 0.5;
+      Color c = ViewPixelColor(view, x, y, u, v);
+      sumR += c.r;
+      sumG += c.g;
+      sumB += c.b;
+      sumA += c.a;
+    }
+
+    int count = samples + 1;
+    pixelBuffer[(size_t)y * view.width + x] = {
+        (unsigned char)((sumR + count / 2) / count),
+        (unsigned char)((sumG + count / 2) / count),
+        (unsigned char)((sumB + count / 2) / count),
+        (unsigned char)((sumA + count / 2) / count)};
+  }
+}
+
+// Distance shaded tiles, a row at a time
+void RenderDistanceTile(const ViewRequest &view, const DirtyRect &r,
+                        Color *pixelBuffer, EscapeSample *sampleBuffer) {
+  EscapeSample row[TILE_SIZE];
+  for (int y = r.y; y < r.y + r.height; y++) {
+    ViewDistanceRow(view, r.x, y, r.width, row);
+    for (int l = 0; l < r.width; l++) {
+      size_t i = (size_t)y * view.width + r.x + l;
+      pixelBuffer[i] = ViewColor(view, (int)row[l].iterations, row[l].smooth,
+                                 row[l].distance);
+      if (sampleBuffer)
+        sampleBuffer[i] = row[l];
+    }
+  }
+}
+
+// If sampleBuffer is given it also receives the escape data per pixel
+void RenderTile(int tileX, int tileY, const ViewRequest &view,
+                Color *pixelBuffer, EscapeSample *sampleBuffer = nullptr) {
+  int width = view.width;
+  int height = view.height;
+
+  // Start of the tile in x direction
+  int startX = tileX * TILE_SIZE;
+
+  // End of the tile in x direction
+  // Min because the tile might go out of bounds
+  int endX = std::min(startX + TILE_SIZE, width);
+
+  // Start of the tile in y direction
+  int startY = tileY * TILE_SIZE;
+
+  // End of the tile in y direction
+  // Min because the tile might go out of bounds
+  int endY = std::min(startY + TILE_SIZE, height);
+
+  DirtyRect rect = {startX, startY, endX - startX, endY - startY};
+  if (view.distanceShading) {
+    RenderDistanceTile(view, rect, pixelBuffer, sampleBuffer);
+  } else {
+    EscapeSample row[TILE_SIZE];
+    for (int y = startY; y < endY; y++) {
+      ViewSampleRow(view, startX, y, rect.width,
+                    view.smoothColoring || sampleBuffer, row);
+      for (int x = startX; x < endX; x++) {
+        const EscapeSample &sample = row[x - startX];
+        pixelBuffer[y * width + x] =
+            ViewColor(view, (int)sample.iterations, sample.smooth);
+        if (sampleBuffer)
+          sampleBuffer[y * width + x] = sample;
+      }
+    }
+  }
+
+  if (view.antialias > 0)
+    AntialiasRect(view, rect, pixelBuffer);
+}
+
+/*
+    Dirty rectangle tracking
+
+    Renders record which pixel rectangles they wrote, and the upload only
+    sends those rectangles to the GPU with UpdateTextureRec instead of
+    re-uploading the whole framebuffer.
+
+    Tile rectangles are coalesced before upload: horizontal neighbours are
+    joined into runs, then runs of identical span are stacked vertically.
+    Full-width runs are contiguous in the pixel buffer and upload straight
+    from it; anything narrower is packed into a staging buffer first, since
+    UpdateTextureRec expects tightly packed rows.
+*/
+struct DirtyRegion {
+  std::vector<DirtyRect> rects;
+
+  void Add(int x, int y, int width, int height) {
+    if (width > 0 && height > 0)
+      rects.push_back({x, y, width, height});
+  }
+
+  // Marks every tile of a width x height frame
+  void AddTiles(int width, int height) {
+    for (int y = 0; y < height; y += TILE_SIZE)
+      for (int x = 0; x < width; x += TILE_SIZE)
+        Add(x, y, std::min(TILE_SIZE, width - x),
+            std::min(TILE_SIZE, height - y));
+  }
+
+  bool Empty() const { return rects.empty(); }
+  void Clear() { rects.clear(); }
+
+  // Merges touching rectangles, assumes they don't overlap
+  void Coalesce() {
+    if (rects.size() < 2)
+      return;
+
+    // Join horizontal neighbours of the same row band into runs
+    std::sort(rects.begin(), rects.end(),
+              [](const DirtyRect &a, const DirtyRect &b) {
+                return a.y != b.y ? a.y < b.y : a.x < b.x;
+              });
+    std::vector<DirtyRect> runs;
+    for (const DirtyRect &r : rects) {
+      DirtyRect *last = runs.empty() ? nullptr : &runs.back();
+      if (last && last->y == r.y && last->height == r.height &&
+          last->x + last->width == r.x) {
+        last->width += r.width;
+      } else {
+        runs.push_back(r);
+      }
+    }
+
+    // Stack runs with the same horizontal span on top of each other
+    std::sort(runs.begin(), runs.end(),
+              [](const DirtyRect &a, const DirtyRect &b) {
+                if (a.x != b.x)
+                  return a.x < b.x;
+                return a.width != b.width ? a.width < b.width : a.y < b.y;
+              });
+    rects.clear();
+    for (const DirtyRect &r : runs) {
+      DirtyRect *last = rects.empty() ? nullptr : &rects.back();
+      if (last && last->x == r.x && last->width == r.width &&
+          last->y + last->height == r.y) {
+        last->height += r.height;
+      } else {
+        rects.push_back(r);
+      }
+    }
+  }
+};
+
+// Uploads the dirty part of a width-wide pixel buffer and clears the region.
+// The texture may be larger than the buffer, which then fills its top-left.
+void UploadDirtyRegion(Texture2D texture, const Color *pixels, int width,
+                       DirtyRegion &dirty, std::vector<Color> &staging) {
+  dirty.Coalesce();
+
+  for (const DirtyRect &r : dirty.rects) {
+    if (r.x == 0 && r.y == 0 && r.width == texture.width &&
+        r.height == texture.height) {
+      // Whole texture, plain upload
+      UpdateTexture(texture, pixels);
+    } else if (r.x == 0 && r.width == width) {
+      // Full-width band, rows are already contiguous
+      UpdateTextureRec(texture,
+                       {0.0f, (float)r.y, (float)r.width, (float)r.height},
+                       pixels + (size_t)r.y * width);
+    } else {
+      // Pack the rows of the rectangle tightly
+      staging.resize((size_t)r.width * r.height);
+      for (int row = 0; row < r.height; row++) {
+        const Color *src = pixels + (size_t)(r.y + row) * width + r.x;
+        std::copy(src, src + r.width, staging.begin() + (size_t)row * r.width);
+      }
+      Rectangle rec = {(float)r.x, (float)r.y, (float)r.width,
+                       (float)r.height};
+      UpdateTextureRec(texture, rec, staging.data());
+    }
+  }
+
+  dirty.Clear();
+}
+
+struct RenderStats {
+  double milliseconds = 0.0;
+  int tiles = 0;
+  int threads = 0;
+  bool cancelled = false; // Superseded by a newer request before finishing
+  int cachedTiles = 0;    // Tiles served by the tile cache
+  EscapeCounters counters; // All zero unless built with MANDELBROT_COUNTERS
+};
+
+// A render is cancelled once a newer generation has been requested
+struct CancelToken {
+  const std::atomic<uint64_t> *latest = nullptr;
+  uint64_t generation = 0;
+
+  bool Cancelled() const {
+    return latest && latest->load(std::memory_order_relaxed) != generation;
+  }
+};
+
+/*
+    Persistent worker pool
+
+    Threads are started once and live for the whole program instead of
+    being spawned per frame. Tasks get the index of the worker running
+    them, which is used as the trace lane and to pick per-worker slots.
+
+    Background tasks (the Julia preview) only run while no other task is
+    queued. They can't be interrupted, so background jobs keep their
+    tasks short: between tiles they check ForegroundWaiting and step
+    aside, see RenderJob::Run.
+*/
+struct WorkerPool {
+  std::vector<std::thread> threads;
+  std::mutex mutex; // Guards the task queues and stopping
+  std::condition_variable wake;
+  std::deque<std::function<void(int)>> tasks;
+  std::deque<std::function<void(int)>> backgroundTasks;
+  std::atomic<int> foregroundQueued{0}; // tasks.size(), read without lock
+  bool stopping = false;
+
+  explicit WorkerPool(int numThreads) {
+    for (int t = 0; t < numThreads; t++)
+      threads.emplace_back([this, t]() { Loop(t); });
+  }
+
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads)
+      thread.join();
+  }
+
+  int Size() const { return (int)threads.size(); }
+
+  void Submit(std::function<void(int)> task, bool background = false) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (background) {
+        backgroundTasks.push_back(std::move(task));
+      } else {
+        tasks.push_back(std::move(task));
+        foregroundQueued.store((int)tasks.size(), std::memory_order_relaxed);
+      }
+    }
+    wake.notify_one();
+  }
+
+  // Whether foreground tasks wait for a worker
+  bool ForegroundWaiting() const {
+    return foregroundQueued.load(std::memory_order_relaxed) > 0;
+  }
+
+  void Loop(int worker) {
+    while (true) {
+      std::function<void(int)> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() {
+          return !tasks.empty() || !backgroundTasks.empty() || stopping;
+        });
+        if (!tasks.empty()) {
+          task = std::move(tasks.front());
+          tasks.pop_front();
+          foregroundQueued.store((int)tasks.size(), std::memory_order_relaxed);
+        } else if (!backgroundTasks.empty()) {
+          task = std::move(backgroundTasks.front());
+          backgroundTasks.pop_front();
+        } else {
+          return;
+        }
+      }
+      task(worker);
+    }
+  }
+};
+
+// The shared render pool, one thread per hardware core
+WorkerPool &RenderPool() {
+  static WorkerPool pool(std::max(1u, std::thread::hardware_concurrency()));
+  return pool;
+}
+
+// Runs fn(worker, i) for i in 0 .. count - 1 on the render pool and waits.
+// Must not be called from a pool worker, it would wait on itself.
+void ParallelFor(int count, const std::function<void(int, int)> &fn) {
+  WorkerPool &pool = RenderPool();
+  std::atomic<int> next{0};
+  int tasks = std::max(1, std::min(pool.Size(), count));
+  int remaining = tasks;
+  std::mutex doneMutex;
+  std::condition_variable doneSignal;
+
+  for (int t = 0; t < tasks; t++) {
+    pool.Submit([&](int worker) {
+      int i;
+      while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count)
+        fn(worker, i);
+      std::lock_guard<std::mutex> lock(doneMutex);
+      if (--remaining == 0)
+        doneSignal.notify_all();
+    });
+  }
+  std::unique_lock<std::mutex> lock(doneMutex);
+  doneSignal.wait(lock, [&remaining]() { return remaining == 0; });
+}
+
+/*
+    One image being rendered on the pool, tile by tile
+
+    renderTile does the actual work for one TILE_SIZE tile; for views that
+    is RenderTile, the batch modes plug in other per-tile work. Tiles are
+    claimed dynamically: each worker grabs the next tile index
+    with one atomic increment, so fast tiles (outside the set) don't leave
+    a worker idle while another one is stuck on slow tiles near the
+    boundary. Workers check the cancel token between tiles.
+
+    Because a job only occupies the pool while it has unclaimed tiles,
+    several jobs can be in flight at once and workers that run out of
+    tiles in one frame move straight on to the next.
+*/
+struct RenderJob {
+  std::function<void(int, int)> renderTile; // (tileX, tileY)
+  int width = 0;  // Size of the tiled area
+  int height = 0;
+  int viewWidth = 0; // Size of the output if it differs (grid renders)
+  int viewHeight = 0;
+  int offsetX = 0; // Output position of the tiled area, <= 0
+  int offsetY = 0;
+  std::atomic<int> cachedTiles{0};
+  // Optional, called from the worker with the output rectangle of every
+  // finished tile
+  std::function<void(const DirtyRect &)> tileDone;
+  // Optional, run by FinishRender once all tiles are done
+  std::function<void()> finishPass;
+  // Optional, run by the worker that ends the last task before the job
+  // counts as done, for finishing work that stays off the waiting thread
+  std::function<void()> lastTaskPass;
+  // Optional, per tile: set for tiles another tile fills in, which are
+  // neither rendered nor reported (see SkipMirroredTiles)
+  std::vector<char> skipTiles;
+  // Runs only on otherwise idle workers, see WorkerPool
+  bool background = false;
+  CancelToken cancel;
+  int tilesX = 0;
+  int totalTiles = 0;
+  std::atomic<int> nextTile{0};
+  std::atomic<int> activeTasks{0};
+  std::vector<EscapeCounters> workerCounters; // One slot per pool worker
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+
+  std::mutex doneMutex;
+  std::condition_variable doneSignal;
+  bool done = false;
+
+  // Part of the output covered by tile (tileX, tileY)
+  DirtyRect TileRect(int tileX, int tileY) const {
+    int outWidth = viewWidth > 0 ? viewWidth : width;
+    int outHeight = viewHeight > 0 ? viewHeight : height;
+    int x0 = std::max(0, tileX * TILE_SIZE + offsetX);
+    int y0 = std::max(0, tileY * TILE_SIZE + offsetY);
+    int x1 = std::min(outWidth, (tileX + 1) * TILE_SIZE + offsetX);
+    int y1 = std::min(outHeight, (tileY + 1) * TILE_SIZE + offsetY);
+    return {x0, y0, x1 - x0, y1 - y0};
+  }
+
+  // One task of the job. Returns false if it stepped aside for foreground
+  // work, it has to be queued again then (see LaunchTileJob).
+  bool Run(int worker) {
+    std::vector<TraceEvent> workerTrace;
+    std::vector<TraceEvent> *sink = TraceSink(workerTrace);
+
+    bool yielded = false;
+    while (true) {
+      // Background jobs give their worker up between tiles
+      if (background && RenderPool().ForegroundWaiting()) {
+        yielded = true;
+        break;
+      }
+      int tileIdx = nextTile.fetch_add(1, std::memory_order_relaxed);
+      if (tileIdx >= totalTiles || cancel.Cancelled())
+        break;
+      if (!skipTiles.empty() && skipTiles[tileIdx])
+        continue;
+      int tileX = tileIdx % tilesX;
+      int tileY = tileIdx / tilesX;
+      TraceSpan tileSpan(sink, "tile", "render", worker + 1, tileX, tileY);
+      renderTile(tileX, tileY);
+      if (tileDone)
+        tileDone(TileRect(tileX, tileY));
+    }
+    TraceSubmit(workerTrace);
+
+#ifdef MANDELBROT_COUNTERS
+    // Merge this worker's counters into its slot of the frame
+    workerCounters[worker].Merge(threadCounters);
+    threadCounters = EscapeCounters();
+#endif
+    if (yielded)
+      return false;
+
+    // The last task out marks the job finished
+    if (activeTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      if (lastTaskPass && !cancel.Cancelled())
+        lastTaskPass();
+      std::lock_guard<std::mutex> lock(doneMutex);
+      end = std::chrono::steady_clock::now();
+      done = true;
+      doneSignal.notify_all();
+    }
+    return true;
+  }
+
+  // Whether all tiles are done, without waiting
+  bool Done() {
+    std::lock_guard<std::mutex> lock(doneMutex);
+    return done;
+  }
+};
+
+// Sets up a job over the tiles of a width x height image, not started yet
+std::shared_ptr<RenderJob> MakeTileJob(int width, int height,
+                                       CancelToken cancel = CancelToken()) {
+  auto job = std::make_shared<RenderJob>();
+  job->width = width;
+  job->height = height;
+  job->cancel = cancel;
+
+  // Create tiles for better load balancing
+  job->tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+  int tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+  job->totalTiles = job->tilesX * tilesY;
+  return job;
+}
+
+// Queues one task of the job, again whenever it steps aside
+void SubmitJobTask(const std::shared_ptr<RenderJob> &job) {
+  RenderPool().Submit(
+      [job](int worker) {
+        if (!job->Run(worker))
+          SubmitJobTask(job);
+      },
+      job->background);
+}
+
+// Queues the job's tiles on the pool and returns without waiting
+void LaunchTileJob(const std::shared_ptr<RenderJob> &job) {
+  WorkerPool &pool = RenderPool();
+  job->workerCounters.resize(pool.Size());
+  job->start = std::chrono::steady_clock::now();
+
+  // One task per worker, each keeps claiming tiles until none are left
+  int tasks = std::max(1, std::min(pool.Size(), job->totalTiles));
+  job->activeTasks.store(tasks, std::memory_order_relaxed);
+  for (int t = 0; t < tasks; t++)
+    SubmitJobTask(job);
+}
+
+// Queues all tiles of a width x height image and returns without waiting
+std::shared_ptr<RenderJob>
+StartTileJob(int width, int height, std::function<void(int, int)> renderTile,
+             CancelToken cancel = CancelToken()) {
+  std::shared_ptr<RenderJob> job = MakeTileJob(width, height, cancel);
+  job->renderTile = std::move(renderTile);
+  LaunchTileJob(job);
+  return job;
+}
+
+/*
+    Histogram coloring
+
+    The hue of escape count n is the fraction of the escaped pixels that
+    escaped within n iterations, so every color band covers about the same
+    area however high the iteration limit is.
+
+    The pass runs over the escape counts of a finished render:
+      1. Every worker counts its share of the pixels into its own
+         histogram, no atomics.
+      2. The bins are split into blocks; each block sums its bins across
+         the worker histograms (the reduction) and its own total.
+      3. A scan over the few block totals gives each block its offset,
+         then every block writes the running sum (the CDF) of its bins
+         straight into the palette.
+    All steps are parallel and touch each pixel once, so even with
+    millions of iterations the pass costs a small part of the render.
+*/
+std::shared_ptr<const std::vector<Color>>
+HistogramPalette(const std::vector<EscapeSample> &samples, int maxIter) {
+  int workers = RenderPool().Size();
+  size_t bins = (size_t)maxIter;
+
+  // 1. Per-worker histograms over pixel chunks
+  std::vector<std::vector<uint32_t>> histograms(workers);
+  size_t pixelCount = samples.size();
+  int chunks = workers * 4;
+  ParallelFor(chunks, [&](int worker, int chunk) {
+    std::vector<uint32_t> &histogram = histograms[worker];
+    if (histogram.empty())
+      histogram.assign(bins, 0);
+    size_t begin = pixelCount * chunk / chunks;
+    size_t end = pixelCount * (chunk + 1) / chunks;
+    for (size_t i = begin; i < end; i++)
+      if (samples[i].iterations < bins)
+        histogram[samples[i].iterations]++;
+  });
+
+  // 2. Reduce across workers, block by block
+  int blocks = (int)std::min<size_t>(bins, (size_t)workers * 4);
+  std::vector<uint64_t> totals(bins);
+  std::vector<uint64_t> blockSums(blocks + 1, 0);
+  ParallelFor(blocks, [&](int, int block) {
+    size_t begin = bins * block / blocks, end = bins * (block + 1) / blocks;
+    uint64_t sum = 0;
+    for (size_t bin = begin; bin < end; bin++) {
+      uint64_t total = 0;
+      for (const std::vector<uint32_t> &histogram : histograms)
+        if (!histogram.empty())
+          total += histogram[bin];
+      totals[bin] = total;
+      sum += total;
+    }
+    blockSums[block + 1] = sum;
+  });
+
+  // 3. Exclusive scan of the block sums, then the CDF into the palette
+  for (int block = 0; block < blocks; block++)
+    blockSums[block + 1] += blockSums[block];
+  double escaped = (double)std::max<uint64_t>(1, blockSums[blocks]);
+
+  auto palette = std::make_shared<std::vector<Color>>(bins);
+  ParallelFor(blocks, [&](int, int block) {
+    size_t begin = bins * block / blocks, end = bins * (block + 1) / blocks;
+    uint64_t running = blockSums[block];
+    for (size_t bin = begin; bin < end; bin++) {
+      running += totals[bin];
+      (*palette)[bin] = ColorFromHSV((float)(255.0 * running / escaped), 0.5f,
+                                     1.2f);
+    }
+  });
+  return palette;
+}
+
+// Recolors a finished render from its escape data with the histogram
+// palette, then anti-aliases it with the same palette if asked to
+void ApplyHistogramColoring(ViewRequest view,
+                            const std::vector<EscapeSample> &samples,
+                            Color *pixelBuffer) {
+  if (!view.palette)
+    view.palette = HistogramPalette(samples, view.maxIter);
+
+  int tilesX = (view.width + TILE_SIZE - 1) / TILE_SIZE;
+  int tilesY = (view.height + TILE_SIZE - 1) / TILE_SIZE;
+  ParallelFor(tilesX * tilesY, [&](int, int tile) {
+    DirtyRect r = {tile % tilesX * TILE_SIZE, tile / tilesX * TILE_SIZE, 0, 0};
+    r.width = std::min(TILE_SIZE, view.width - r.x);
+    r.height = std::min(TILE_SIZE, view.height - r.y);
+    for (int y = r.y; y < r.y + r.height; y++)
+      for (int x = r.x; x < r.x + r.width; x++) {
+        size_t i = (size_t)y * view.width + x;
+        pixelBuffer[i] = ViewColor(view, (int)samples[i].iterations,
+                                   samples[i].smooth, samples[i].distance);
+      }
+    if (view.antialias > 0)
+      AntialiasRect(view, r, pixelBuffer);
+  });
+}
+
+/*
+    Persistent on-disk tile cache
+
+    Tiles of grid views (see GridView) are identified by their exact
+    rectangle: grid spacing, tile column/row on that grid (in TILE_SIZE
+    steps from the complex origin), iteration limit, formula and for Julia
+    sets their c. Tiles are
+    stored content-addressed under a 64-bit hash of that key, as
+    dir/<first two hex digits>/<hash>.fxi, each file a one-tile iteration
+    file. The header repeats the tile rectangle, so a hash collision is
+    detected on load instead of showing the wrong tile.
+
+    The cache holds EscapeSample data rather than colors, so a palette
+    change still hits. Its size is capped with LRU eviction: the index of
+    files is built once from the directory, hits refresh the file's mtime
+    so recency survives restarts, and stores past the cap delete the least
+    recently used files. Stores are written by a background thread so
+    workers never wait for the disk.
+*/
+struct TileKey {
+  int formula;
+  int maxIter;
+  double spacingX, spacingY;
+  int64_t tileX, tileY; // Grid tile index, TILE_SIZE pixels each
+  bool julia = false;     // Julia set of juliaC, see ViewRequest
+  Complex juliaC = {0.0, 0.0};
+
+  bool operator==(const TileKey &o) const {
+    return formula == o.formula && maxIter == o.maxIter &&
+           spacingX == o.spacingX && spacingY == o.spacingY &&
+           tileX == o.tileX && tileY == o.tileY && julia == o.julia &&
+           juliaC.real == o.juliaC.real && juliaC.imag == o.juliaC.imag;
+  }
+
+  uint64_t Hash() const {
+    // FNV-1a over the raw key bytes
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](const void *bytes, size_t count) {
+      for (size_t i = 0; i < count; i++) {
+        hash ^= ((const unsigned char *)bytes)[i];
+        hash *= 1099511628211ull;
+      }
+    };
+    mix(&formula, sizeof(formula));
+    mix(&maxIter, sizeof(maxIter));
+    mix(&spacingX, sizeof(spacingX));
+    mix(&spacingY, sizeof(spacingY));
+    mix(&tileX, sizeof(tileX));
+    mix(&tileY, sizeof(tileY));
+    if (julia) {
+      mix(&juliaC.real, sizeof(juliaC.real));
+      mix(&juliaC.imag, sizeof(juliaC.imag));
+    }
+    return hash;
+  }
+
+  // The rectangle as stored in the file header
+  FxiHeader Header() const {
+    FxiHeader h = {};
+    memcpy(h.magic, FXI_MAGIC, sizeof(FXI_MAGIC));
+    h.version = FXI_VERSION;
+    h.headerSize = FXI_HEADER_SIZE;
+    h.width = h.height = h.tileSize = TILE_SIZE;
+    h.channels = FXI_CHANNEL_ITERATIONS | FXI_CHANNEL_SMOOTH;
+    h.maxIter = maxIter;
+    h.formula = formula | (julia ? FXI_FORMULA_JULIA : 0);
+    h.reMin = tileX * TILE_SIZE * spacingX;
+    h.reMax = (tileX + 1) * TILE_SIZE * spacingX;
+    h.imMax = -(tileY * TILE_SIZE) * spacingY;
+    h.imMin = -((tileY + 1) * TILE_SIZE) * spacingY;
+    if (julia) {
+      h.juliaRe = juliaC.real;
+      h.juliaIm = juliaC.imag;
+    }
+    return h;
+  }
+};
+
+// One grid tile worth of samples, row-major
+using SampleTile = std::vector<EscapeSample>;
+
+struct DiskTileCache {
+  struct Entry {
+    uint64_t bytes;
+    uint64_t lastUse; // Larger is more recent
+  };
+
+  std::string dir;
+  uint64_t capacityBytes = 0;
+
+  std::mutex mutex; // Guards everything below
+  std::unordered_map<uint64_t, Entry> index;
+  uint64_t totalBytes = 0;
+  uint64_t useCounter = 0;
+  std::deque<std::pair<TileKey, SampleTile>> pendingStores;
+  std::condition_variable storeSignal;
+  std::thread storeThread;
+  bool stopping = false;
+  std::atomic<uint64_t> hits{0}, misses{0};
+
+  std::string PathFor(uint64_t hash) const {
+    char name[24];
+    snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+    return dir + "/" + std::string(name, 2) + "/" + name + ".fxi";
+  }
+
+  void Open(const std::string &cacheDir, uint64_t capacity) {
+    dir = cacheDir;
+    capacityBytes = capacity;
+
+    // Rebuild the index, oldest files get the lowest use counters
+    std::vector<std::pair<std::filesystem::file_time_type, uint64_t>> files;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    for (auto it = std::filesystem::recursive_directory_iterator(dir, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator();
+         it.increment(ec)) {
+      if (!it->is_regular_file() || it->path().extension() != ".fxi")
+        continue;
+      uint64_t hash = strtoull(it->path().stem().string().c_str(), nullptr, 16);
+      index[hash] = {(uint64_t)it->file_size(), 0};
+      totalBytes += it->file_size();
+      files.push_back({it->last_write_time(), hash});
+    }
+    std::sort(files.begin(), files.end());
+    for (auto &file : files)
+      index[file.second].lastUse = ++useCounter;
+
+    storeThread = std::thread([this]() { StoreLoop(); });
+  }
+
+  void Close() {
+    if (!storeThread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    storeSignal.notify_one();
+    storeThread.join();
+  }
+
+  ~DiskTileCache() { Close(); }
+
+  bool Load(const TileKey &key, SampleTile &samples) {
+    uint64_t hash = key.Hash();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = index.find(hash);
+      if (it == index.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      it->second.lastUse = ++useCounter;
+    }
+
+    std::string path = PathFor(hash);
+    FILE *file = fopen(path.c_str(), "rb");
+    bool ok = false;
+    if (file) {
+      FxiHeader expected = key.Header(), header;
+      unsigned char headerBytes[FXI_HEADER_SIZE];
+      std::vector<uint32_t> iterations(TILE_SIZE * TILE_SIZE);
+      std::vector<float> smooth(TILE_SIZE * TILE_SIZE);
+      ok = fread(headerBytes, 1, FXI_HEADER_SIZE, file) == FXI_HEADER_SIZE;
+      memcpy(&header, headerBytes, sizeof(header));
+      ok = ok && memcmp(&header, &expected, sizeof(header)) == 0 &&
+           fread(iterations.data(), 4, iterations.size(), file) ==
+               iterations.size() &&
+           fread(smooth.data(), 4, smooth.size(), file) == smooth.size();
+      fclose(file);
+
+      if (ok) {
+        samples.resize(TILE_SIZE * TILE_SIZE);
+        for (size_t i = 0; i < samples.size(); i++)
+          samples[i] = {iterations[i], smooth[i], 0.0f};
+        // Keep recency across restarts
+        std::error_code ec;
+        std::filesystem::last_write_time(
+            path, std::filesystem::file_time_type::clock::now(), ec);
+      }
+    }
+
+    (ok ? hits : misses).fetch_add(1, std::memory_order_relaxed);
+    return ok;
+  }
+
+  // Queues the tile for writing, dropped if the writer is far behind
+  void Store(const TileKey &key, const SampleTile &samples) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (pendingStores.size() >= 1024)
+        return;
+      pendingStores.push_back({key, samples});
+    }
+    storeSignal.notify_one();
+  }
+
+  void StoreLoop() {
+    while (true) {
+      std::pair<TileKey, SampleTile> item;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        storeSignal.wait(
+            lock, [this]() { return !pendingStores.empty() || stopping; });
+        if (pendingStores.empty())
+          return;
+        item = std::move(pendingStores.front());
+        pendingStores.pop_front();
+      }
+      WriteTile(item.first, item.second);
+    }
+  }
+
+  void WriteTile(const TileKey &key, const SampleTile &samples) {
+    uint64_t hash = key.Hash();
+    std::string path = PathFor(hash);
+    std::string temp = path + ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(
+        std::filesystem::path(path).parent_path(), ec);
+
+    FILE *file = fopen(temp.c_str(), "wb");
+    if (!file)
+      return;
+    FxiHeader header = key.Header();
+    unsigned char headerBytes[FXI_HEADER_SIZE] = {};
+    memcpy(headerBytes, &header, sizeof(header));
+    std::vector<uint32_t> iterations(samples.size());
+    std::vector<float> smooth(samples.size());
+    for (size_t i = 0; i < samples.size(); i++) {
+      iterations[i] = samples[i].iterations;
+      smooth[i] = samples[i].smooth;
+    }
+    bool ok = fwrite(headerBytes, 1, FXI_HEADER_SIZE, file) ==
+                  FXI_HEADER_SIZE &&
+              fwrite(iterations.data(), 4, iterations.size(), file) ==
+                  iterations.size() &&
+              fwrite(smooth.data(), 4, smooth.size(), file) == smooth.size();
+    ok = fclose(file) == 0 && ok;
+
+    // Rename so readers never see a half-written tile
+    if (ok)
+      std::filesystem::rename(temp, path, ec);
+    if (!ok || ec) {
+      std::filesystem::remove(temp, ec);
+      return;
+    }
+
+    uint64_t bytes = FXI_HEADER_SIZE + samples.size() * 8;
+    std::vector<uint64_t> evict;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = index.find(hash);
+      if (it != index.end())
+        totalBytes -= it->second.bytes;
+      index[hash] = {bytes, ++useCounter};
+      totalBytes += bytes;
+
+      // Over the cap: drop least recently used files down to 90%
+      if (totalBytes > capacityBytes) {
+        std::vector<std::pair<uint64_t, uint64_t>> byAge; // (lastUse, hash)
+        for (auto &entry : index)
+          byAge.push_back({entry.second.lastUse, entry.first});
+        std::sort(byAge.begin(), byAge.end());
+        for (auto &old : byAge) {
+          if (totalBytes <= capacityBytes / 10 * 9)
+            break;
+          totalBytes -= index[old.second].bytes;
+          index.erase(old.second);
+          evict.push_back(old.second);
+        }
+      }
+    }
+    for (uint64_t old : evict)
+      std::filesystem::remove(PathFor(old), ec);
+  }
+};
+
+/*
+    In-memory tile cache
+
+    Sits in front of the disk cache for interactive navigation. Every zoom
+    level is its own aligned grid of TILE_SIZE tiles, so the levels form a
+    tile pyramid keyed by (level spacing, tile column, tile row); zooming
+    back out and in again, or panning back over a seen area, finds its
+    tiles here without touching the disk. Least recently used tiles are
+    dropped once the memory budget is exceeded.
+*/
+struct MemoryTileCache {
+  struct Entry {
+    TileKey key;
+    std::shared_ptr<const SampleTile> samples;
+  };
+
+  uint64_t capacityBytes = 0;
+
+  std::mutex mutex; // Guards everything below
+  std::list<Entry> lru; // Most recently used first
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+  uint64_t totalBytes = 0;
+
+  static uint64_t TileBytes() {
+    return TILE_SIZE * TILE_SIZE * sizeof(EscapeSample);
+  }
+
+  bool Load(const TileKey &key, SampleTile &samples) {
+    std::shared_ptr<const SampleTile> found;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = index.find(key.Hash());
+      if (it == index.end() || !(it->second->key == key))
+        return false;
+      lru.splice(lru.begin(), lru, it->second);
+      found = it->second->samples;
+    }
+    samples = *found; // Copy outside the lock
+    return true;
+  }
+
+  void Store(const TileKey &key, const SampleTile &samples) {
+    auto shared = std::make_shared<const SampleTile>(samples);
+    uint64_t hash = key.Hash();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(hash);
+    if (it != index.end()) {
+      // Same slot: newest tile wins, also on the rare hash collision
+      it->second->key = key;
+      it->second->samples = shared;
+      lru.splice(lru.begin(), lru, it->second);
+      return;
+    }
+
+    lru.push_front({key, shared});
+    index[hash] = lru.begin();
+    totalBytes += TileBytes();
+    while (totalBytes > capacityBytes && !lru.empty()) {
+      index.erase(lru.back().key.Hash());
+      lru.pop_back();
+      totalBytes -= TileBytes();
+    }
+  }
+};
+
+// Set when a cache is enabled, consulted by every grid view render
+static DiskTileCache *tileCache = nullptr;
+static MemoryTileCache *memoryCache = nullptr;
+
+static const uint64_t DEFAULT_CACHE_MB = 512;
+static const uint64_t DEFAULT_MEMORY_CACHE_MB = 256;
+
+// Samples of one grid tile: from the memory or disk cache, or computed and
+// then cached
+bool GridTileSamples(const TileKey &key, SampleTile &samples) {
+  if (memoryCache && memoryCache->Load(key, samples))
+    return true;
+  if (tileCache && tileCache->Load(key, samples)) {
+    if (memoryCache)
+      memoryCache->Store(key, samples);
+    return true;
+  }
+
+  // The tile as a grid view of its own
+  FxiHeader bounds = key.Header();
+  ViewRequest view = {TILE_SIZE,    TILE_SIZE,    bounds.reMin, bounds.reMax,
+                      bounds.imMin, bounds.imMax, key.maxIter};
+  view.formula = key.formula;
+  view.julia = key.julia;
+  view.juliaC = key.juliaC;
+  view.spacingX = key.spacingX;
+  view.spacingY = key.spacingY;
+  view.originX = key.tileX * TILE_SIZE;
+  view.originY = key.tileY * TILE_SIZE;
+
+  samples.resize(TILE_SIZE * TILE_SIZE);
+  for (int ty = 0; ty < TILE_SIZE; ty++)
+    ViewSampleRow(view, 0, ty, TILE_SIZE, true, &samples[ty * TILE_SIZE]);
+
+  if (memoryCache)
+    memoryCache->Store(key, samples);
+  if (tileCache)
+    tileCache->Store(key, samples);
+  return false;
+}
+
+inline int64_t FloorDiv(int64_t a, int64_t b) {
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/*
+    Sets up the job for a grid view while a cache is enabled, it works by
+    grid tile rather than by view tile: the job walks the TILE_SIZE tiles
+    of the global grid that overlap the view, gets each one's samples from
+    the cache (or computes and stores them) and colors the overlapping part
+    into the view.
+*/
+std::shared_ptr<RenderJob> MakeGridJob(const ViewRequest &view,
+                                       Color *pixelBuffer,
+                                       EscapeSample *sampleBuffer,
+                                       CancelToken cancel) {
+  int64_t firstX = FloorDiv(view.originX, TILE_SIZE);
+  int64_t firstY = FloorDiv(view.originY, TILE_SIZE);
+  int64_t lastX = FloorDiv(view.originX + view.width - 1, TILE_SIZE);
+  int64_t lastY = FloorDiv(view.originY + view.height - 1, TILE_SIZE);
+  int gridTilesX = (int)(lastX - firstX + 1);
+  int gridTilesY = (int)(lastY - firstY + 1);
+
+  std::shared_ptr<RenderJob> job = MakeTileJob(
+      gridTilesX * TILE_SIZE, gridTilesY * TILE_SIZE, cancel);
+  RenderJob *jobPtr = job.get(); // The job owns the callback
+  job->renderTile = [=](int tileX, int tileY) {
+    TileKey key = {view.formula,   view.maxIter,   view.spacingX,
+                   view.spacingY,  firstX + tileX, firstY + tileY,
+                   view.julia,     view.juliaC};
+    SampleTile samples;
+    if (GridTileSamples(key, samples))
+      jobPtr->cachedTiles.fetch_add(1, std::memory_order_relaxed);
+
+    // Overlap of this grid tile with the view, in view pixels
+    int64_t tileLeft = key.tileX * TILE_SIZE - view.originX;
+    int64_t tileTop = key.tileY * TILE_SIZE - view.originY;
+    int x0 = (int)std::max<int64_t>(0, tileLeft);
+    int y0 = (int)std::max<int64_t>(0, tileTop);
+    int x1 = (int)std::min<int64_t>(view.width, tileLeft + TILE_SIZE);
+    int y1 = (int)std::min<int64_t>(view.height, tileTop + TILE_SIZE);
+    for (int y = y0; y < y1; y++) {
+      const EscapeSample *row = &samples[(y - tileTop) * TILE_SIZE];
+      for (int x = x0; x < x1; x++) {
+        const EscapeSample &sample = row[x - tileLeft];
+        size_t i = (size_t)y * view.width + x;
+        pixelBuffer[i] = ViewColor(view, (int)sample.iterations, sample.smooth);
+        if (sampleBuffer)
+          sampleBuffer[i] = sample;
+      }
+    }
+    if (view.antialias > 0)
+      AntialiasRect(view, {x0, y0, x1 - x0, y1 - y0}, pixelBuffer);
+  };
+  job->viewWidth = view.width;
+  job->viewHeight = view.height;
+  job->offsetX = (int)(firstX * TILE_SIZE - view.originX);
+  job->offsetY = (int)(firstY * TILE_SIZE - view.originY);
+  return job;
+}
+
+/*
+    Point symmetry
+
+    Julia sets of maps with f(-z) = f(z) are symmetric about the origin:
+    the orbit of -z joins that of z after one step, so both pixels come
+    out bit for bit the same. On the pixel grid the mirror of grid pixel
+    g is exactly -g, which in view pixels takes (x, y) to
+        (-2 * originX - x, -2 * originY - y)
+    A job tile below the real axis whose mirror lies wholly inside the
+    view is not iterated at all. Instead the tiles holding its mirror
+    copy their finished pixels and escape data over and report them done,
+    which halves the work of a view centered on the origin. Every skipped
+    pixel has exactly one source pixel, in a tile that is iterated, so
+    the copies need no locking.
+*/
+inline bool MirroredRect(const ViewRequest &view, const DirtyRect &r) {
+  int64_t mirrorX = -2 * view.originX, mirrorY = -2 * view.originY;
+  return view.originY + r.y > 0 && mirrorX - (r.x + r.width - 1) >= 0 &&
+         mirrorX - r.x < view.width && mirrorY - (r.y + r.height - 1) >= 0 &&
+         mirrorY - r.y < view.height;
+}
+
+// Makes job skip the tiles of a point symmetric grid view that their
+// mirror fills in, see above
+void SkipMirroredTiles(RenderJob &job, const ViewRequest &view,
+                       Color *pixelBuffer, EscapeSample *sampleBuffer) {
+  std::vector<char> mirrored(job.totalTiles);
+  bool any = false;
+  for (int t = 0; t < job.totalTiles; t++) {
+    mirrored[t] =
+        MirroredRect(view, job.TileRect(t % job.tilesX, t / job.tilesX));
+    any = any || mirrored[t];
+  }
+  // Nothing to skip, the mirror may then lie far outside int range
+  if (!any)
+    return;
+  job.skipTiles = std::move(mirrored);
+
+  RenderJob *jobPtr = &job; // The job owns the callback
+  std::function<void(int, int)> render = std::move(job.renderTile);
+  job.renderTile = [=](int tileX, int tileY) {
+    render(tileX, tileY);
+
+    // The mirror of this tile, clipped to the view
+    DirtyRect r = jobPtr->TileRect(tileX, tileY);
+    int mirrorX = (int)(-2 * view.originX), mirrorY = (int)(-2 * view.originY);
+    int x0 = std::max(0, mirrorX - (r.x + r.width - 1));
+    int y0 = std::max(0, mirrorY - (r.y + r.height - 1));
+    int x1 = std::min(view.width, mirrorX - r.x + 1);
+    int y1 = std::min(view.height, mirrorY - r.y + 1);
+    if (x0 >= x1 || y0 >= y1)
+      return;
+
+    // Filled in per skipped tile it overlaps
+    for (int ty = (y0 - jobPtr->offsetY) / TILE_SIZE;
+         ty <= (y1 - 1 - jobPtr->offsetY) / TILE_SIZE; ty++) {
+      for (int tx = (x0 - jobPtr->offsetX) / TILE_SIZE;
+           tx <= (x1 - 1 - jobPtr->offsetX) / TILE_SIZE; tx++) {
+        if (!jobPtr->skipTiles[ty * jobPtr->tilesX + tx])
+          continue;
+        DirtyRect t = jobPtr->TileRect(tx, ty);
+        int tx0 = std::max(t.x, x0), tx1 = std::min(t.x + t.width, x1);
+        int ty0 = std::max(t.y, y0), ty1 = std::min(t.y + t.height, y1);
+        for (int y = ty0; y < ty1; y++) {
+          for (int x = tx0; x < tx1; x++) {
+            size_t to = (size_t)y * view.width + x;
+            size_t from = (size_t)(mirrorY - y) * view.width + (mirrorX - x);
+            pixelBuffer[to] = pixelBuffer[from];
+            if (sampleBuffer)
+              sampleBuffer[to] = sampleBuffer[from];
+          }
+        }
+        if (jobPtr->tileDone)
+          jobPtr->tileDone({tx0, ty0, tx1 - tx0, ty1 - ty0});
+      }
+    }
+  };
+}
+
+// Queues all tiles of view on the pool and returns without waiting,
+// as a background job (see WorkerPool) if background is set
+std::shared_ptr<RenderJob>
+StartRender(const ViewRequest &finalView, Color *pixelBuffer,
+            CancelToken cancel = CancelToken(),
+            std::function<void(const DirtyRect &)> tileDone = nullptr,
+            bool background = false) {
+  // Histogram coloring needs every escape count first: tiles get the plain
+  // palette as a preview and keep their data, FinishRender recolors them
+  ViewRequest view = finalView;
+  std::shared_ptr<std::vector<EscapeSample>> samples;
+  if (view.histogramColoring && !view.palette) {
+    samples = std::make_shared<std::vector<EscapeSample>>(
+        (size_t)view.width * view.height);
+    view.antialias = 0;
+  }
+  EscapeSample *sampleBuffer = samples ? samples->data() : nullptr;
+
+  // The caches hold no distance estimates
+  std::shared_ptr<RenderJob> job;
+  if ((!tileCache && !memoryCache) || !view.OnGrid() ||
+      view.distanceShading) {
+    job = MakeTileJob(view.width, view.height, cancel);
+    job->renderTile = [view, pixelBuffer, sampleBuffer](int tileX,
+                                                        int tileY) {
+      RenderTile(tileX, tileY, view, pixelBuffer, sampleBuffer);
+    };
+  } else {
+    job = MakeGridJob(view, pixelBuffer, sampleBuffer, cancel);
+  }
+  if (ViewKernels(view).pointSymmetric && view.OnGrid())
+    SkipMirroredTiles(*job, view, pixelBuffer, sampleBuffer);
+
+  if (samples) {
+    job->finishPass = [finalView, pixelBuffer, samples]() {
+      ApplyHistogramColoring(finalView, *samples, pixelBuffer);
+    };
+  }
+  job->tileDone = std::move(tileDone);
+  job->background = background;
+  LaunchTileJob(job);
+  return job;
+}
+
+// Blocks until the job is done and collects its stats
+RenderStats FinishRender(RenderJob &job, DirtyRegion *dirty = nullptr) {
+  {
+    std::unique_lock<std::mutex> lock(job.doneMutex);
+    job.doneSignal.wait(lock, [&job]() { return job.done; });
+  }
+  if (job.finishPass && !job.cancel.Cancelled()) {
+    job.finishPass();
+    job.end = std::chrono::steady_clock::now();
+  }
+
+  RenderStats stats;
+  stats.milliseconds =
+      std::chrono::duration<double, std::milli>(job.end - job.start).count();
+  stats.tiles = job.totalTiles;
+  stats.threads = RenderPool().Size();
+  stats.cancelled = job.cancel.Cancelled();
+  stats.cachedTiles = job.cachedTiles.load(std::memory_order_relaxed);
+  for (const EscapeCounters &c : job.workerCounters)
+    stats.counters.Merge(c);
+  if (dirty && !stats.cancelled) {
+    if (job.viewWidth > 0)
+      dirty->AddTiles(job.viewWidth, job.viewHeight);
+    else
+      dirty->AddTiles(job.width, job.height);
+  }
+  return stats;
+}
+
+/*
+    Renders a whole view into pixelBuffer on the worker pool and waits.
+    The written tiles are added to dirty when one is given.
+*/
+RenderStats
+RenderView(const ViewRequest &view, Color *pixelBuffer,
+           DirtyRegion *dirty = nullptr, CancelToken cancel = CancelToken(),
+           std::function<void(const DirtyRect &)> tileDone = nullptr) {
+  std::shared_ptr<RenderJob> job =
+      StartRender(view, pixelBuffer, cancel, std::move(tileDone));
+  return FinishRender(*job, dirty);
+}
+
+// Prints counters as percentages of the pixels they cover
+void PrintCounters(const EscapeCounters &c) {
+  double pixels = std::max<uint64_t>(1, c.Pixels());
+  printf("  cardioid exit : %12llu (%5.1f%%)\n", (unsigned long long)c.cardioid,
+         100.0 * c.cardioid / pixels);
+  printf("  bulb exit     : %12llu (%5.1f%%)\n", (unsigned long long)c.bulb,
+         100.0 * c.bulb / pixels);
+  printf("  radius exit   : %12llu (%5.1f%%)\n", (unsigned long long)c.radius,
+         100.0 * c.radius / pixels);
+  printf("  interior exit : %12llu (%5.1f%%)\n", (unsigned long long)c.interior,
+         100.0 * c.interior / pixels);
+  printf("  escaped       : %12llu (%5.1f%%)\n", (unsigned long long)c.escaped,
+         100.0 * c.escaped / pixels);
+  printf("  max iter      : %12llu (%5.1f%%)\n", (unsigned long long)c.maxIter,
+         100.0 * c.maxIter / pixels);
+  printf("  iterations    : %12llu (%.1f per pixel)\n",
+         (unsigned long long)c.iterations, c.iterations / pixels);
+}
+
+/*
+    Benchmark harness: mandelbrot --bench [runs]
+
+    Renders the default view offscreen at WIDTH x HEIGHT, no window needed,
+    and prints per-run timings plus the hot-path counters of the last run.
+*/
+int RunBenchmark(int runs) {
+  std::vector<Color> pixelBuffer(WIDTH * HEIGHT);
+  double best = 1e300, total = 0.0;
+  RenderStats stats;
+
+  for (int run = 0; run < runs; run++) {
+    stats = RenderView({WIDTH, HEIGHT, -2.0, 1.5, -1.5, 1.5},
+                       pixelBuffer.data());
+    best = std::min(best, stats.milliseconds);
+    total += stats.milliseconds;
+    printf("run %d: %.2f ms\n", run, stats.milliseconds);
+  }
+
+  printf("%dx%d, %d tiles, %d threads: best %.2f ms, avg %.2f ms\n", WIDTH,
+         HEIGHT, stats.tiles, stats.threads, best, total / runs);
+  if (COUNTERS_ENABLED) {
+    printf("counters (last run):\n");
+    PrintCounters(stats.counters);
+  }
+  return 0;
+}
+
+/*
+    Regression checks: mandelbrot --check
+
+    Runs the escape kernels on points whose answer is known and returns
+    nonzero when one of them comes out wrong. The deep point escapes at
+    iteration 11123 (by a 128-bit float orbit) after a long stretch in
+    which the orbit derivative shrinks, which fooled a der-only interior
+    test into calling it interior at iteration 8167.
+*/
+struct KernelCheck {
+  const char *name;
+  const char *re, *im;
+  double offset; // Added to re, below the resolution of the decimal text
+  int maxIter;
+  int lowest, highest; // Accepted iteration counts
+};
+
+static const KernelCheck KERNEL_CHECKS[] = {
+    {"deep escape", "-0.743643887037158704752191506114774",
+     "0.131825904205311970493132056385139", -1.5e-23, 20000, 11122, 11125},
+    {"period-3 bulb", "-0.1225", "0.7449", 0.0, 20000, 20000, 20000},
+};
+
+int RunChecks() {
+  int failures = 0;
+  for (const KernelCheck &check : KERNEL_CHECKS) {
+    DoubleDouble cx = DDAdd(ParseDoubleDouble(check.re), check.offset);
+    DoubleDouble cy = ParseDoubleDouble(check.im);
+    DoubleDouble laneRe[DD_LANES], laneIm[DD_LANES];
+    EscapeSample samples[DD_LANES];
+    for (int l = 0; l < DD_LANES; l++) {
+      laneRe[l] = cx;
+      laneIm[l] = cy;
+    }
+    mandelbrotDoubleDoubleLanes<Mandelbrot>(laneRe, laneIm, check.maxIter,
+                                            false, samples);
+    int scalar = mandelbrotEscapeDD<Mandelbrot>(cx, cy, check.maxIter,
+                                                nullptr);
+    int lanes = (int)samples[0].iterations;
+    bool ok = scalar >= check.lowest && scalar <= check.highest &&
+              lanes >= check.lowest && lanes <= check.highest;
+    printf("%-14s: scalar %d, lanes %d, expected %d..%d  %s\n", check.name,
+           scalar, lanes, check.lowest, check.highest, ok ? "ok" : "FAILED");
+    failures += !ok;
+  }
+  return failures ? 1 : 0;
+}
+
+// Stats overlay in the top-left corner, toggled with H
+void DrawStatsHud(const RenderStats &stats, bool busy) {
+  int lines = (COUNTERS_ENABLED ? 7 : 2) + (tileCache || memoryCache ? 1 : 0);
+  DrawRectangle(5, 35, 300, 10 + lines * 18, Fade(BLACK, 0.6f));
+
+  int y = 40;
+  DrawText(TextFormat("Render: %.1f ms%s", stats.milliseconds,
+                      busy ? "  (rendering...)" : ""),
+           10, y, 16, RAYWHITE);
+  y += 18;
+  DrawText(TextFormat("Tiles: %d  Threads: %d", stats.tiles, stats.threads),
+           10, y, 16, RAYWHITE);
+  if (tileCache || memoryCache) {
+    y += 18;
+    DrawText(TextFormat("Cached: %d / %d tiles", stats.cachedTiles,
+                        stats.tiles),
+             10, y, 16, RAYWHITE);
+  }
+
+  if (COUNTERS_ENABLED) {
+    const EscapeCounters &c = stats.counters;
+    double pixels = std::max<uint64_t>(1, c.Pixels());
+    y += 18;
+    DrawText(TextFormat("Cardioid: %.1f%%  Bulb: %.1f%%",
+                        100.0 * c.cardioid / pixels, 100.0 * c.bulb / pixels),
+             10, y, 16, SKYBLUE);
+    y += 18;
+    DrawText(TextFormat("Radius>2: %.1f%%  Interior: %.1f%%",
+                        100.0 * c.radius / pixels, 100.0 * c.interior / pixels),
+             10, y, 16, SKYBLUE);
+    y += 18;
+    DrawText(TextFormat("Escaped: %.1f%%", 100.0 * c.escaped / pixels), 10, y,
+             16, SKYBLUE);
+    y += 18;
+    DrawText(TextFormat("Max iter: %.1f%%", 100.0 * c.maxIter / pixels), 10,
+             y, 16, SKYBLUE);
+    y += 18;
+    DrawText(TextFormat("Iterations/pixel: %.1f", c.iterations / pixels), 10,
+             y, 16, SKYBLUE);
+  }
+}
+
+/*
+    Resize without churn
+
+    A live resize drag changes the window size dozens of times per second.
+    Pixel buffers grow geometrically and never shrink, so a drag settles
+    into a handful of allocations instead of one per size. The texture is
+    allocated with spare capacity as well and only the top-left
+    width x height part of it is used; it is recreated only once the size
+    has stopped changing for RESIZE_SETTLE_SECONDS, and only if the window
+    outgrew it. Until then the last frame is drawn reprojected into the new
+    window geometry.
+*/
+static const double RESIZE_SETTLE_SECONDS = 0.2;
+
+// Like vector::resize, but grows capacity by 1.5x steps
+void ResizePixels(std::vector<Color> &pixels, size_t count) {
+  if (count > pixels.capacity())
+    pixels.reserve(std::max(count, pixels.capacity() + pixels.capacity() / 2));
+  pixels.resize(count);
+}
+
+// Texture with room for frames up to width x height
+Texture2D LoadCanvasTexture(int width, int height) {
+  Image image = GenImageColor(width, height, BLACK);
+  Texture2D texture = LoadTextureFromImage(image);
+  UnloadImage(image);
+  SetTextureFilter(texture, TEXTURE_FILTER_BILINEAR);
+  return texture;
+}
+
+// Grows the canvas texture geometrically if the window no longer fits in it
+void EnsureCanvasTexture(Texture2D &texture, int width, int height) {
+  if (width <= texture.width && height <= texture.height)
+    return;
+  int newWidth = std::max(width, texture.width + texture.width / 2);
+  int newHeight = std::max(height, texture.height + texture.height / 2);
+  UnloadTexture(texture);
+  texture = LoadCanvasTexture(newWidth, newHeight);
+}
+
+/*
+    Draws the content of the texture, which shows view content, at the
+    place that view occupies in the screen view. Identical views draw 1:1;
+    after a resize, pan or zoom the old pixels are stretched and shifted
+    into the new geometry as a placeholder until the next frame arrives.
+*/
+void DrawReprojected(Texture2D texture, const ViewRequest &content,
+                     const ViewRequest &screen) {
+  double scaleX = screen.width / (screen.Re_max - screen.Re_min);
+  double scaleY = screen.height / (screen.Im_max - screen.Im_min);
+  double shiftRe = AnchorShiftRe(content, screen);
+  double shiftIm = AnchorShiftIm(content, screen);
+
+  Rectangle source = {0.0f, 0.0f, (float)content.width,
+                      (float)content.height};
+  Rectangle dest = {
+      (float)((content.Re_min + shiftRe - screen.Re_min) * scaleX),
+      (float)((screen.Im_max - content.Im_max - shiftIm) * scaleY),
+      (float)((content.Re_max - content.Re_min) * scaleX),
+      (float)((content.Im_max - content.Im_min) * scaleY)};
+  DrawTexturePro(texture, source, dest, {0.0f, 0.0f}, 0.0f, WHITE);
+}
+
+// Nearest-neighbour copy of the pixels showing view from into the geometry
+// of view to, parts of to that from doesn't cover turn black. Used as the
+// placeholder a new render refines tile by tile.
+void ResampleView(const std::vector<Color> &src, const ViewRequest &from,
+                  std::vector<Color> &dst, const ViewRequest &to) {
+  dst.assign((size_t)to.width * to.height, BLACK);
+
+  // Offsets of to, moved to be relative to from's anchor
+  double shiftRe = AnchorShiftRe(to, from);
+  double shiftIm = AnchorShiftIm(to, from);
+
+  // Source column of every destination column, -1 if outside
+  std::vector<int> columns(to.width);
+  double fromScaleX = from.width / (from.Re_max - from.Re_min);
+  for (int x = 0; x < to.width; x++) {
+    double re = to.Re_min + (x + 0.5) * (to.Re_max - to.Re_min) / to.width;
+    double sx = floor((re + shiftRe - from.Re_min) * fromScaleX);
+    columns[x] = (sx >= 0 && sx < from.width) ? (int)sx : -1;
+  }
+
+  double fromScaleY = from.height / (from.Im_max - from.Im_min);
+  for (int y = 0; y < to.height; y++) {
+    double im = to.Im_max - (y + 0.5) * (to.Im_max - to.Im_min) / to.height;
+    double sy = floor((from.Im_max - im - shiftIm) * fromScaleY);
+    if (sy < 0 || sy >= from.height)
+      continue;
+    const Color *srcRow = &src[(size_t)sy * from.width];
+    Color *dstRow = &dst[(size_t)y * to.width];
+    for (int x = 0; x < to.width; x++)
+      if (columns[x] >= 0)
+        dstRow[x] = srcRow[columns[x]];
+  }
+}
+
+/*
+    Triple buffering between the render thread and the UI thread
+
+    Three frames rotate between three owners: the render thread writes the
+    back frame, the UI thread reads the front frame, and the middle slot
+    holds the most recently completed frame. Handing a frame over is one
+    atomic exchange of the middle slot on either side, so neither thread
+    ever waits for the other and the UI never sees a half-written frame.
+
+    The middle slot packs the frame index in the low bits and a FRESH flag
+    that tells the UI a frame arrived since it last looked.
+*/
+struct Frame {
+  std::vector<Color> pixels;
+  int width = 0;
+  int height = 0;
+  ViewRequest view = {}; // The view these pixels show
+  uint64_t generation = 0; // Request it was rendered for
+  RenderStats stats;
+  DirtyRegion dirty; // Tiles not uploaded to the texture yet
+};
+
+struct TripleBuffer {
+  static constexpr int INDEX_MASK = 3;
+  static constexpr int FRESH = 4;
+
+  Frame frames[3];
+  int back = 0;  // Owned by the render thread
+  int front = 1; // Owned by the UI thread
+  std::atomic<int> middle{2};
+
+  // Render thread: hand the finished back frame over, take the middle one
+  void Publish() {
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) &
+           INDEX_MASK;
+  }
+
+  // UI thread: swap in the newest frame, returns false if there is none
+  bool Acquire() {
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+    return true;
+  }
+};
+
+// Copy of one finished tile of a render in progress
+struct TilePatch {
+  DirtyRect rect;
+  std::vector<Color> pixels;
+};
+
+/*
+    Runs RenderView on its own thread so the UI keeps drawing, panning and
+    uploading while the next frame is computed.
+
+    Only the newest request matters: every Request bumps the generation,
+    which cancels a render that is still in flight, and the render thread
+    always picks up the latest pending view.
+
+    While a render runs, its finished tiles are copied out as patches so the
+    UI can refine a placeholder tile by tile instead of waiting for the
+    whole frame.
+*/
+struct BackgroundRenderer {
+  TripleBuffer buffers;
+  std::thread thread;
+  std::mutex mutex; // Guards pending, hasPending and stopping
+  std::condition_variable wake;
+  ViewRequest pending = {};
+  bool hasPending = false;
+  bool stopping = false;
+  std::atomic<uint64_t> generation{0};
+  std::atomic<bool> busy{false};
+
+  std::mutex progressMutex; // Guards the progress members
+  uint64_t progressGeneration = 0; // Render the patches belong to
+  ViewRequest progressView = {};
+  bool progressStarted = false; // Not seen by TakeProgress yet
+  std::vector<TilePatch> patches;
+
+  void Start() { thread = std::thread([this]() { Loop(); }); }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    generation.fetch_add(1, std::memory_order_relaxed); // Cancel in-flight
+    wake.notify_one();
+    thread.join();
+  }
+
+  void Request(const ViewRequest &view) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending = view;
+      hasPending = true;
+      generation.fetch_add(1, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+  }
+
+  bool AcquireFrame() { return buffers.Acquire(); }
+  Frame &Front() { return buffers.frames[buffers.front]; }
+  bool Busy() const { return busy.load(std::memory_order_relaxed); }
+
+  // UI thread: moves the finished tiles of the current render to out.
+  // Returns true when that render started since the last call, with its
+  // view, so the UI can switch its placeholder to the new geometry first.
+  bool TakeProgress(ViewRequest &view, uint64_t &renderGeneration,
+                    std::vector<TilePatch> &out) {
+    std::lock_guard<std::mutex> lock(progressMutex);
+    out.swap(patches);
+    patches.clear();
+    view = progressView;
+    renderGeneration = progressGeneration;
+    bool started = progressStarted;
+    progressStarted = false;
+    return started;
+  }
+
+  void Loop() {
+    int renderTid = RenderPool().Size() + 1;
+    std::vector<TraceEvent> renderTrace;
+
+    while (true) {
+      ViewRequest view;
+      uint64_t myGeneration;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return hasPending || stopping; });
+        if (stopping)
+          return;
+        view = pending;
+        hasPending = false;
+        myGeneration = generation.load(std::memory_order_relaxed);
+        busy.store(true, std::memory_order_relaxed);
+      }
+
+      Frame &frame = buffers.frames[buffers.back];
+      frame.width = view.width;
+      frame.height = view.height;
+      frame.view = view;
+      frame.generation = myGeneration;
+      ResizePixels(frame.pixels, (size_t)view.width * view.height);
+      frame.dirty.Clear();
+
+      {
+        std::lock_guard<std::mutex> lock(progressMutex);
+        progressGeneration = myGeneration;
+        progressView = view;
+        progressStarted = true;
+        patches.clear();
+      }
+      const Color *pixels = frame.pixels.data();
+      auto tileDone = [this, pixels, myGeneration,
+                       width = view.width](const DirtyRect &r) {
+        TilePatch patch = {r, std::vector<Color>((size_t)r.width * r.height)};
+        for (int row = 0; row < r.height; row++) {
+          const Color *src = pixels + (size_t)(r.y + row) * width + r.x;
+          std::copy(src, src + r.width,
+                    patch.pixels.begin() + (size_t)row * r.width);
+        }
+        std::lock_guard<std::mutex> lock(progressMutex);
+        if (progressGeneration == myGeneration)
+          patches.push_back(std::move(patch));
+      };
+
+      {
+        TraceSpan renderSpan(TraceSink(renderTrace), "render", "render",
+                             renderTid);
+        frame.stats = RenderView(view, frame.pixels.data(), &frame.dirty,
+                                 {&generation, myGeneration}, tileDone);
+      }
+      TraceSubmit(renderTrace);
+
+      // A cancelled frame is incomplete, drop it and start the next one
+      if (!frame.stats.cancelled)
+        buffers.Publish();
+      busy.store(false, std::memory_order_relaxed);
+    }
+  }
+};
+
+/*
+    Live Julia preview
+
+    While exploring, an inset shows the Julia set of the point under the
+    cursor. It is rendered at JULIA_PREVIEW_SIZE pixels as a background
+    job, so it only takes workers the main view leaves idle and never
+    delays its tiles by more than the preview tile in progress. Moving
+    the cursor cancels the render in flight, and the latest c waits until
+    it has stopped, so however fast the cursor moves there is at most one
+    render and one pending c, all in one pixel buffer. The last finished
+    image stays up in the meantime.
+
+    The preview view is off the pixel grid, so its many short-lived
+    Julia sets stay out of the tile caches.
+*/
+static const int JULIA_PREVIEW_SIZE = 192;
+
+struct JuliaPreview {
+  std::atomic<uint64_t> generation{0};
+  std::shared_ptr<RenderJob> job; // Render in flight, if any
+  Complex jobC = {0.0, 0.0};      // Its c
+  std::vector<Color> pixels;      // Its output
+  Texture2D texture = {};
+  Complex shownC = {0.0, 0.0}; // c of the image on the texture
+  bool hasImage = false;
+  ViewRequest requested = {}; // Latest request
+  bool pending = false;       // requested waits for the job to stop
+
+  // Asks for the Julia set of c, cancelling the render in flight.
+  // Does nothing if that is the latest request already.
+  void Request(Complex c, int formula, bool smoothColoring) {
+    c = JuliaParameter(c);
+    if (requested.julia && requested.juliaC.real == c.real &&
+        requested.juliaC.imag == c.imag && requested.formula == formula &&
+        requested.smoothColoring == smoothColoring)
+      return;
+
+    generation.fetch_add(1);
+    ViewRequest view = {JULIA_PREVIEW_SIZE, JULIA_PREVIEW_SIZE, -1.75, 1.75,
+                        -1.75, 1.75, MAX_ITER};
+    view.formula = formula;
+    view.julia = true;
+    view.juliaC = c;
+    view.smoothColoring = smoothColoring;
+    requested = view;
+    pending = true;
+    StartPending();
+  }
+
+  // Starts the pending request once no render is in flight
+  void StartPending() {
+    if (!pending || job)
+      return;
+    pending = false;
+    jobC = requested.juliaC;
+    pixels.resize((size_t)requested.width * requested.height);
+    job = StartRender(requested, pixels.data(),
+                      {&generation, generation.load()}, nullptr, true);
+  }
+
+  // UI thread, once per frame: uploads the finished render and starts the
+  // pending one
+  void Update() {
+    if (job && job->Done()) {
+      bool cancelled = FinishRender(*job).cancelled;
+      job.reset();
+      if (!cancelled) {
+        if (texture.id == 0)
+          texture = LoadCanvasTexture(JULIA_PREVIEW_SIZE, JULIA_PREVIEW_SIZE);
+        UpdateTexture(texture, pixels.data());
+        shownC = jobC;
+        hasImage = true;
+      }
+    }
+    StartPending();
+  }
+
+  // The inset with its top-left corner at x, y
+  void Draw(int x, int y) const {
+    if (!hasImage)
+      return;
+    DrawTexture(texture, x, y, WHITE);
+    DrawRectangleLines(x - 1, y - 1, JULIA_PREVIEW_SIZE + 2,
+                       JULIA_PREVIEW_SIZE + 2, GOLD);
+    DrawText(TextFormat("julia %.4f %+.4fi", shownC.real, shownC.imag), x,
+             y + JULIA_PREVIEW_SIZE + 4, 12, GOLD);
+  }
+
+  // Cancels what is still running and waits for it
+  void Stop() {
+    generation.fetch_add(1);
+    if (job)
+      FinishRender(*job);
+    job.reset();
+    pending = false;
+    if (texture.id != 0)
+      UnloadTexture(texture);
+    texture = {};
+    hasImage = false;
+    requested = {};
+  }
+};
+
+/* Command line helpers for the headless batch modes */
+
+// Returns the offset-th argument after "--name", or fallback if absent
+const char *FindOption(int argc, char **argv, const char *name,
+                       const char *fallback = nullptr, int offset = 1) {
+  for (int i = 1; i + offset < argc; i++) {
+    if (std::string(argv[i]) == name)
+      return argv[i + offset];
+  }
+  return fallback;
+}
+
+// True if the flag "--name" is present
+bool HasOption(int argc, char **argv, const char *name) {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == name)
+      return true;
+  }
+  return false;
+}
+
+// Opens the tile cache from --cache dir [--cache-mb N], or at defaultDir
+// when --cache isn't given. A size of 0 leaves the cache off.
+void OpenTileCache(DiskTileCache &cache, int argc, char **argv,
+                   const char *defaultDir) {
+  const char *dir = FindOption(argc, argv, "--cache", defaultDir);
+  uint64_t megabytes = strtoull(
+      FindOption(argc, argv, "--cache-mb",
+                 std::to_string(DEFAULT_CACHE_MB).c_str()),
+      nullptr, 10);
+  if (!dir || megabytes == 0 || tileCache)
+    return;
+  cache.Open(dir, megabytes << 20);
+  tileCache = &cache;
+}
+
+// Square-pixel view of width x height centered on (re, im), span wide
+ViewRequest ViewFromCenter(int width, int height, DoubleDouble re,
+                           DoubleDouble im, double span) {
+  // Square pixels on the grid of that spacing, so tiles can be cached
+  double spacing = std::max(span / width, DOUBLE_DOUBLE_MIN_SPACING);
+  span = spacing * width;
+  return PlaceView(width, height, spacing, spacing, DDAdd(re, -span / 2.0),
+                   DDAdd(im, spacing * height / 2.0), MAX_ITER);
+}
+
+static const char *COLOR_OPTIONS_USAGE =
+    "[--formula F] [--julia RE IM] [--aa N] [--smooth] [--hist] [--distance]";
+
+// Reads --formula name (see FORMULAS), Mandelbrot if missing or unknown
+int FormulaFromOptions(int argc, char **argv) {
+  const char *name = FindOption(argc, argv, "--formula", "mandelbrot");
+  int formula = FindFormula(name);
+  if (formula >= 0)
+    return formula;
+  fprintf(stderr, "unknown formula %s, using mandelbrot\n", name);
+  return FORMULA_MANDELBROT;
+}
+
+// Reads --julia re im into c, false if the option is missing
+bool JuliaFromOptions(int argc, char **argv, Complex &c) {
+  if (!HasOption(argc, argv, "--julia"))
+    return false;
+  c.real = atof(FindOption(argc, argv, "--julia", "0", 1));
+  c.imag = atof(FindOption(argc, argv, "--julia", "0", 2));
+  Complex inside = JuliaParameter(c);
+  if (inside.real != c.real || inside.imag != c.imag)
+    fprintf(stderr, "julia: |c| > 2, using %g %+gi\n", inside.real,
+            inside.imag);
+  c = inside;
+  return true;
+}
+
+// Reads --center re im (all digits are kept for deep zooms) and --span w,
+// defaulting to the whole set, --formula name for the formula,
+// --julia re im for its Julia set of that c (centered on 0 by default),
+// --aa N for N extra samples on edge pixels, --smooth for smooth coloring,
+// --hist for histogram coloring and --distance for distance shading
+// (ignored for formulas and Julia sets without a distance estimate)
+ViewRequest ViewFromOptions(int argc, char **argv, int width, int height) {
+  Complex juliaC = {0.0, 0.0};
+  bool julia = JuliaFromOptions(argc, argv, juliaC);
+  DoubleDouble re = ParseDoubleDouble(
+      FindOption(argc, argv, "--center", julia ? "0" : "-0.75", 1));
+  DoubleDouble im =
+      ParseDoubleDouble(FindOption(argc, argv, "--center", "0", 2));
+  double span = atof(FindOption(argc, argv, "--span", "3.5"));
+  ViewRequest view = ViewFromCenter(width, height, re, im, span);
+  const char *iterations = FindOption(argc, argv, "--iter");
+  if (iterations)
+    view.maxIter = std::max(1, atoi(iterations));
+  view.formula = FormulaFromOptions(argc, argv);
+  view.julia = julia;
+  view.juliaC = juliaC;
+  view.antialias = std::clamp(atoi(FindOption(argc, argv, "--aa", "0")), 0, 64);
+  view.smoothColoring = HasOption(argc, argv, "--smooth");
+  view.histogramColoring = HasOption(argc, argv, "--hist");
+  view.distanceShading =
+      HasOption(argc, argv, "--distance") && ViewKernels(view).distance;
+  return view;
+}
+
+// For images rendered in pieces (bands, pyramid blocks): a histogram of
+// each piece would color them differently, so the palette is taken from
+// a preview of the whole image at most 1024 pixels wide instead
+void SharePreviewPalette(ViewRequest &image) {
+  if (!image.histogramColoring || image.palette)
+    return;
+  double scale = 1024.0 / std::max(image.width, image.height);
+  ViewRequest preview = {std::max(1, (int)(image.width * scale)),
+                         std::max(1, (int)(image.height * scale)),
+                         image.Re_min,
+                         image.Re_max,
+                         image.Im_min,
+                         image.Im_max,
+                         image.maxIter};
+  preview.formula = image.formula;
+  preview.julia = image.julia;
+  preview.juliaC = image.juliaC;
+  preview.anchorRe = image.anchorRe;
+  preview.anchorIm = image.anchorIm;
+
+  std::vector<EscapeSample> samples((size_t)preview.width * preview.height);
+  FinishRender(*StartTileJob(
+      preview.width, preview.height, [&](int tileX, int tileY) {
+        int endX = std::min((tileX + 1) * TILE_SIZE, preview.width);
+        int endY = std::min((tileY + 1) * TILE_SIZE, preview.height);
+        for (int y = tileY * TILE_SIZE; y < endY; y++)
+          for (int x = tileX * TILE_SIZE; x < endX; x++)
+            samples[(size_t)y * preview.width + x] =
+                ViewPointSample(preview, x, y, 0.0, 0.0, false, false);
+      }));
+  image.palette = HistogramPalette(samples, image.maxIter);
+}
+
+// Rows y0 .. y0 + rows of a larger view, as a view of its own
+ViewRequest BandView(const ViewRequest &image, int y0, int rows) {
+  double imagPerRow = (image.Im_max - image.Im_min) / image.height;
+  ViewRequest band = image;
+  band.height = rows;
+  band.Im_min = image.Im_max - (y0 + rows) * imagPerRow;
+  band.Im_max = image.Im_max - y0 * imagPerRow;
+  band.originY = image.originY + y0;
+  return band;
+}
+
+/*
+    Background image writer for the batch modes
+
+    Encoding PNGs is slower than rendering them at low iteration counts, so
+    finished images are queued and written by a few helper threads. The
+    queue is bounded: Submit blocks when it is full, which caps memory and
+    lets the disk push back on the renderer instead of piling up frames.
+    Paths ending in .ppm are written as binary PPM, anything else goes
+    through raylib's ExportImage (PNG by default).
+*/
+struct ImageJob {
+  std::string path;
+  int width, height;
+  std::vector<Color> pixels;
+};
+
+bool WriteImageFile(const ImageJob &job) {
+  std::string ext = std::filesystem::path(job.path).extension().string();
+  if (ext == ".ppm") {
+    FILE *file = fopen(job.path.c_str(), "wb");
+    if (!file)
+      return false;
+    fprintf(file, "P6\n%d %d\n255\n", job.width, job.height);
+    std::vector<unsigned char> rgb(job.pixels.size() * 3);
+    for (size_t i = 0; i < job.pixels.size(); i++) {
+      rgb[i * 3 + 0] = job.pixels[i].r;
+      rgb[i * 3 + 1] = job.pixels[i].g;
+      rgb[i * 3 + 2] = job.pixels[i].b;
+    }
+    bool ok = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+    return fclose(file) == 0 && ok;
+  }
+
+  Image image = {(void *)job.pixels.data(), job.width, job.height, 1,
+                 PIXELFORMAT_UNCOMPRESSED_R8G8B8A8};
+  return ExportImage(image, job.path.c_str());
+}
+
+struct AsyncImageWriter {
+  std::vector<std::thread> threads;
+  std::mutex mutex; // Guards queue and stopping
+  std::condition_variable notEmpty, notFull;
+  std::deque<ImageJob> queue;
+  size_t capacity = 8;
+  bool stopping = false;
+  std::atomic<int> written{0};
+  std::atomic<int> failed{0};
+
+  void Start(int numThreads, size_t queueCapacity) {
+    capacity = std::max<size_t>(1, queueCapacity);
+    for (int t = 0; t < numThreads; t++)
+      threads.emplace_back([this]() { Loop(); });
+  }
+
+  void Submit(ImageJob job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return queue.size() < capacity; });
+    queue.push_back(std::move(job));
+    lock.unlock();
+    notEmpty.notify_one();
+  }
+
+  // Writes everything still queued, then stops the threads
+  void Finish() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    notEmpty.notify_all();
+    for (auto &thread : threads)
+      thread.join();
+    threads.clear();
+  }
+
+  void Loop() {
+    while (true) {
+      std::unique_lock<std::mutex> lock(mutex);
+      notEmpty.wait(lock, [this]() { return !queue.empty() || stopping; });
+      if (queue.empty())
+        return; // Stopping and drained
+      ImageJob job = std::move(queue.front());
+      queue.pop_front();
+      lock.unlock();
+      notFull.notify_one();
+
+      if (WriteImageFile(job)) {
+        written.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        failed.fetch_add(1, std::memory_order_relaxed);
+        fprintf(stderr, "cannot write %s\n", job.path.c_str());
+      }
+    }
+  }
+};
+
+// Helper threads for encoding, leave most cores to the renderer
+int WriterThreadCount() {
+  return std::max(1u, std::thread::hardware_concurrency() / 4);
+}
+
+/*
+    Poster mode: mandelbrot --poster W H out.ppm [--center re im]
+                                                 [--span w] [--band rows]
+
+    A 100k x 100k print would need 40 GB as one pixel buffer, so the image
+    is rendered in horizontal bands of TILE_SIZE-aligned rows. Each band
+    goes through the normal tile scheduler and is then streamed to a binary
+    PPM (P6) file, which ImageMagick, GIMP, ffmpeg and friends all read.
+
+    Two band buffers alternate: while band k is written to disk on a helper
+    thread, band k + 1 is already rendering. Peak memory is two bands
+    (plus their RGB copies), no matter how tall the image is.
+*/
+int RunPoster(int argc, char **argv) {
+  if (argc < 5) {
+    fprintf(stderr, "usage: %s --poster W H out.ppm [--center re im] "
+                    "[--span w] [--iter n] [--band rows] %s\n",
+            argv[0], COLOR_OPTIONS_USAGE);
+    return 1;
+  }
+
+  int width = atoi(argv[2]);
+  int height = atoi(argv[3]);
+  const char *path = argv[4];
+  if (width <= 0 || height <= 0) {
+    fprintf(stderr, "poster: invalid size %s x %s\n", argv[2], argv[3]);
+    return 1;
+  }
+
+  // Default band: about 64 MB of pixels, rounded to whole tile rows
+  int defaultBand =
+      (int)std::max<int64_t>(1, (64ll << 20) / (4ll * width) / TILE_SIZE) *
+      TILE_SIZE;
+  int bandRows = atoi(FindOption(argc, argv, "--band", "0"));
+  bandRows = bandRows > 0 ? bandRows : defaultBand;
+  bandRows = std::min(bandRows, height);
+
+  ViewRequest image = ViewFromOptions(argc, argv, width, height);
+  SharePreviewPalette(image);
+
+  FILE *file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "poster: cannot open %s\n", path);
+    return 1;
+  }
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+  std::vector<Color> bands[2];
+  std::vector<unsigned char> rgb[2];
+  std::thread writer;
+  bool writeFailed = false;
+  int bandCount = (height + bandRows - 1) / bandRows;
+  auto start = std::chrono::steady_clock::now();
+
+  for (int band = 0; band < bandCount; band++) {
+    int y0 = band * bandRows;
+    int rows = std::min(bandRows, height - y0);
+    std::vector<Color> &pixels = bands[band % 2];
+    std::vector<unsigned char> &bytes = rgb[band % 2];
+
+    ViewRequest view = BandView(image, y0, rows);
+    ResizePixels(pixels, (size_t)width * rows);
+    RenderView(view, pixels.data());
+
+    // PPM has no alpha channel, pack RGB
+    bytes.resize(pixels.size() * 3);
+    for (size_t i = 0; i < pixels.size(); i++) {
+      bytes[i * 3 + 0] = pixels[i].r;
+      bytes[i * 3 + 1] = pixels[i].g;
+      bytes[i * 3 + 2] = pixels[i].b;
+    }
+
+    // The previous band must be on disk before this one is queued
+    if (writer.joinable())
+      writer.join();
+    writer = std::thread([&bytes, file, &writeFailed]() {
+      if (fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size())
+        writeFailed = true;
+    });
+
+    printf("\rband %d/%d", band + 1, bandCount);
+    fflush(stdout);
+  }
+
+  if (writer.joinable())
+    writer.join();
+  if (fclose(file) != 0)
+    writeFailed = true;
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("\n%s: %dx%d in %d bands of %d rows, %.1f s\n", path, width, height,
+         bandCount, bandRows, seconds);
+
+  if (writeFailed) {
+    fprintf(stderr, "poster: write to %s failed\n", path);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+    Tile pyramid export: mandelbrot --pyramid outdir [--levels N]
+                                         [--center re im] [--span w]
+
+    Writes the square region of side span around center as an XYZ web map
+    pyramid: level z has 2^z x 2^z tiles of PYRAMID_TILE pixels stored as
+    outdir/z/x/y.png, with y = 0 at the top (largest imaginary part).
+
+    Only the finest level is iterated. It is rendered in blocks of
+    2^PYRAMID_BLOCK_LEVELS x 2^PYRAMID_BLOCK_LEVELS tiles, one RenderView
+    call per block so the whole thread pool works on it, and every coarser
+    level is a 2x2 box-filtered reduction of the level below. That is far
+    cheaper than re-iterating and anti-aliases the coarse levels for free.
+    Above block level the recursion keeps only four children per level
+    alive, so memory stays at one block plus a few tiles.
+*/
+static const int PYRAMID_TILE = 4 * TILE_SIZE; // 256, the web map standard
+static const int PYRAMID_BLOCK_LEVELS = 2;      // Blocks of 4x4 tiles
+
+struct PyramidExport {
+  std::string dir;
+  int levels;         // Finest level, z = 0 .. levels
+  ViewRequest region; // Whole square region, width/height unused
+  AsyncImageWriter *writer;
+};
+
+// Averages 2x2 pixel blocks of a size x size image
+std::vector<Color> Downsample2x(const std::vector<Color> &src, int size) {
+  int half = size / 2;
+  std::vector<Color> dst((size_t)half * half);
+  for (int y = 0; y < half; y++) {
+    const Color *row0 = &src[(size_t)(2 * y) * size];
+    const Color *row1 = row0 + size;
+    for (int x = 0; x < half; x++) {
+      const Color &a = row0[2 * x], &b = row0[2 * x + 1];
+      const Color &c = row1[2 * x], &d = row1[2 * x + 1];
+      dst[(size_t)y * half + x] = {
+          (unsigned char)((a.r + b.r + c.r + d.r + 2) / 4),
+          (unsigned char)((a.g + b.g + c.g + d.g + 2) / 4),
+          (unsigned char)((a.b + b.b + c.b + d.b + 2) / 4),
+          (unsigned char)((a.a + b.a + c.a + d.a + 2) / 4)};
+    }
+  }
+  return dst;
+}
+
+// Queues tile (z, x, y), cut from a square image size pixels wide
+void WritePyramidTile(PyramidExport &ex, int z, int64_t x, int64_t y,
+                      const std::vector<Color> &image, int size, int offsetX,
+                      int offsetY) {
+  std::string dir = ex.dir + "/" + std::to_string(z) + "/" + std::to_string(x);
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    ex.writer->failed.fetch_add(1, std::memory_order_relaxed);
+    fprintf(stderr, "pyramid: cannot create %s: %s\n", dir.c_str(),
+            ec.message().c_str());
+    return;
+  }
+
+  ImageJob job = {dir + "/" + std::to_string(y) + ".png", PYRAMID_TILE,
+                  PYRAMID_TILE,
+                  std::vector<Color>((size_t)PYRAMID_TILE * PYRAMID_TILE)};
+  for (int row = 0; row < PYRAMID_TILE; row++) {
+    const Color *src = &image[(size_t)(offsetY + row) * size + offsetX];
+    std::copy(src, src + PYRAMID_TILE,
+              job.pixels.begin() + (size_t)row * PYRAMID_TILE);
+  }
+  ex.writer->Submit(std::move(job));
+}
+
+// Writes tile (z, x, y) and everything below it, returns its pixels
+std::vector<Color> BuildPyramidTile(PyramidExport &ex, int z, int64_t x,
+                                    int64_t y) {
+  int size = PYRAMID_TILE;
+
+  if (ex.levels - z <= PYRAMID_BLOCK_LEVELS) {
+    // Render the whole block at the finest level in one parallel pass
+    int perAxis = 1 << (ex.levels - z);
+    int blockSize = perAxis * PYRAMID_TILE;
+    double tileSpan = (ex.region.Re_max - ex.region.Re_min) / (1ll << z);
+    double Re_min = ex.region.Re_min + x * tileSpan;
+    double Im_max = ex.region.Im_max - y * tileSpan;
+
+    // On the finest level's pixel grid when it is exact, so the blocks
+    // share tiles with other renders at that zoom in the tile cache.
+    // Elsewhere the corner is placed in double-double from the region's,
+    // as a double can't hold it once the finest grid is out of reach.
+    ViewRequest blockView;
+    int64_t scale = (int64_t)1 << ex.levels;
+    int64_t limit = (int64_t)1 << (50 - ex.levels);
+    if (ex.region.OnGrid() && std::llabs(ex.region.originX) < limit &&
+        std::llabs(ex.region.originY) < limit) {
+      blockView = {blockSize, blockSize, Re_min, Re_min + tileSpan,
+                   Im_max - tileSpan, Im_max};
+      blockView.spacingX = ex.region.spacingX / scale;
+      blockView.spacingY = ex.region.spacingY / scale;
+      blockView.originX = ex.region.originX * scale + x * blockSize;
+      blockView.originY = ex.region.originY * scale + y * blockSize;
+    } else {
+      DoubleDouble regionRe = DDAdd(ex.region.anchorRe, ex.region.Re_min);
+      DoubleDouble regionIm = DDAdd(ex.region.anchorIm, ex.region.Im_max);
+      double spacing = tileSpan / blockSize;
+      blockView = PlaceView(blockSize, blockSize, spacing, spacing,
+                            DDAdd(regionRe, x * tileSpan),
+                            DDAdd(regionIm, -(y * tileSpan)), 0);
+    }
+    blockView.antialias = ex.region.antialias;
+    blockView.smoothColoring = ex.region.smoothColoring;
+    blockView.palette = ex.region.palette;
+    blockView.distanceShading = ex.region.distanceShading;
+    blockView.maxIter = ex.region.maxIter;
+    blockView.formula = ex.region.formula;
+    blockView.julia = ex.region.julia;
+    blockView.juliaC = ex.region.juliaC;
+
+    std::vector<Color> block((size_t)blockSize * blockSize);
+    RenderView(blockView, block.data());
+
+    // Cut tiles level by level, halving the block in between
+    for (int level = ex.levels; level >= z; level--) {
+      int k = 1 << (level - z);
+      for (int j = 0; j < k; j++)
+        for (int i = 0; i < k; i++)
+          WritePyramidTile(ex, level, x * k + i, y * k + j, block,
+                           k * PYRAMID_TILE, i * PYRAMID_TILE,
+                           j * PYRAMID_TILE);
+      if (level > z)
+        block = Downsample2x(block, k * PYRAMID_TILE);
+    }
+    return block;
+  }
+
+  // Assemble the four children into a 2x tile and reduce it
+  std::vector<Color> quad((size_t)4 * size * size);
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 2; i++) {
+      std::vector<Color> child =
+          BuildPyramidTile(ex, z + 1, 2 * x + i, 2 * y + j);
+      for (int row = 0; row < size; row++) {
+        size_t dst = (size_t)(j * size + row) * 2 * size + i * size;
+        std::copy(child.begin() + (size_t)row * size,
+                  child.begin() + (size_t)(row + 1) * size,
+                  quad.begin() + dst);
+      }
+    }
+  }
+  std::vector<Color> tile = Downsample2x(quad, 2 * size);
+  WritePyramidTile(ex, z, x, y, tile, size, 0, 0);
+  return tile;
+}
+
+int RunPyramid(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s --pyramid outdir [--levels N] "
+                    "[--center re im] [--span w] [--iter n] %s\n",
+            argv[0], COLOR_OPTIONS_USAGE);
+    return 1;
+  }
+
+  PyramidExport ex;
+  ex.dir = argv[2];
+  ex.levels = atoi(FindOption(argc, argv, "--levels", "4"));
+  if (ex.levels < 0 || ex.levels > 30) {
+    fprintf(stderr, "pyramid: levels must be in 0..30\n");
+    return 1;
+  }
+  // Level 0 is one tile, its pixel grid is snapped to like any view
+  ex.region = ViewFromOptions(argc, argv, PYRAMID_TILE, PYRAMID_TILE);
+  // The finest level stops at the deepest zoom too, see ViewFromCenter
+  double spacing = (ex.region.Re_max - ex.region.Re_min) / PYRAMID_TILE;
+  if (spacing / (1ll << ex.levels) < DOUBLE_DOUBLE_MIN_SPACING) {
+    fprintf(stderr, "pyramid: --levels %d is past the deepest zoom, "
+                    "at most %d for this span\n",
+            ex.levels, ilogb(spacing / DOUBLE_DOUBLE_MIN_SPACING));
+    return 1;
+  }
+  SharePreviewPalette(ex.region);
+
+  AsyncImageWriter writer;
+  writer.Start(WriterThreadCount(), 64);
+  ex.writer = &writer;
+
+  auto start = std::chrono::steady_clock::now();
+  BuildPyramidTile(ex, 0, 0, 0);
+  writer.Finish();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%s: levels 0..%d, %d tiles, %.1f s\n", ex.dir.c_str(), ex.levels,
+         writer.written.load(), seconds);
+  return writer.failed.load() ? 1 : 0;
+}
+
+/*
+    Keyframed zoom video: mandelbrot --video keys.txt outdir [--size W H]
+                                                [--inflight N] [--ext png]
+
+    keys.txt has one keyframe per line, '#' starts a comment:
+
+        # frame  center_re  center_im  span  iterations
+        0        -0.75      0          3.5   100
+        300      -0.743643  0.131825   1e-5  1500
+
+    Every frame from 0 to the last keyframe is written as
+    outdir/frame_00000.png and so on, ready for ffmpeg -i frame_%05d.png.
+
+    Between two keyframes the span is interpolated in log space so the zoom
+    speed looks constant, and the center moves in proportion to how much
+    of the span change has happened, which keeps the zoom target still on
+    screen. Iterations are interpolated linearly.
+
+    Up to N frames are in flight on the worker pool at once. Their tiles
+    share the pool queue, so workers that finish their part of frame k
+    start on frame k + 1 right away instead of idling on the tail of the
+    slowest tile. Finished frames go to the AsyncImageWriter in order, so
+    encoding and disk I/O never stall compute.
+*/
+struct Keyframe {
+  int frame;
+  double re, im, span;
+  int maxIter;
+};
+
+bool LoadKeyframes(const char *path, std::vector<Keyframe> &keys) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    Keyframe key;
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%d %lf %lf %lf %d", &key.frame, &key.re, &key.im,
+               &key.span, &key.maxIter) == 5 &&
+        key.span > 0.0 && key.maxIter > 0)
+      keys.push_back(key);
+  }
+  fclose(file);
+
+  std::sort(keys.begin(), keys.end(),
+            [](const Keyframe &a, const Keyframe &b) {
+              return a.frame < b.frame;
+            });
+  return !keys.empty();
+}
+
+ViewRequest InterpolateKeyframes(const std::vector<Keyframe> &keys, int frame,
+                                 int width, int height) {
+  // Find the segment a -> b containing frame
+  size_t next = 1;
+  while (next < keys.size() && keys[next].frame < frame)
+    next++;
+  const Keyframe &a = keys[std::min(next, keys.size()) - 1];
+  const Keyframe &b = keys[std::min(next, keys.size() - 1)];
+
+  double t = b.frame > a.frame ? (double)(frame - a.frame) / (b.frame - a.frame)
+                               : 0.0;
+  t = std::min(1.0, std::max(0.0, t));
+
+  double span = exp(log(a.span) + (log(b.span) - log(a.span)) * t);
+  double u = fabs(a.span - b.span) > 0.0 ? (a.span - span) / (a.span - b.span)
+                                         : t;
+  double re = a.re + (b.re - a.re) * u;
+  double im = a.im + (b.im - a.im) * u;
+
+  ViewRequest view = ViewFromCenter(width, height, {re, 0.0}, {im, 0.0}, span);
+  view.maxIter = (int)std::lround(a.maxIter + (b.maxIter - a.maxIter) * t);
+  return view;
+}
+
+int RunVideo(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr, "usage: %s --video keys.txt outdir [--size W H] "
+                    "[--inflight N] [--ext png] %s\n",
+            argv[0], COLOR_OPTIONS_USAGE);
+    return 1;
+  }
+
+  std::vector<Keyframe> keys;
+  if (!LoadKeyframes(argv[2], keys)) {
+    fprintf(stderr, "video: no keyframes in %s\n", argv[2]);
+    return 1;
+  }
+
+  std::string dir = argv[3];
+  int width = atoi(FindOption(argc, argv, "--size", "1280", 1));
+  int height = atoi(FindOption(argc, argv, "--size", "720", 2));
+  int inflight = std::max(1, atoi(FindOption(argc, argv, "--inflight", "3")));
+  std::string ext = FindOption(argc, argv, "--ext", "png");
+  int antialias = std::clamp(atoi(FindOption(argc, argv, "--aa", "0")), 0, 64);
+  bool smoothColoring = HasOption(argc, argv, "--smooth");
+  bool histogramColoring = HasOption(argc, argv, "--hist");
+  int formula = FormulaFromOptions(argc, argv);
+  Complex juliaC = {0.0, 0.0};
+  bool julia = JuliaFromOptions(argc, argv, juliaC);
+  bool distanceShading = HasOption(argc, argv, "--distance") && !julia &&
+                         FORMULAS[formula].distance;
+  if (width <= 0 || height <= 0) {
+    fprintf(stderr, "video: invalid size\n");
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    fprintf(stderr, "video: cannot create %s: %s\n", dir.c_str(),
+            ec.message().c_str());
+    return 1;
+  }
+
+  AsyncImageWriter writer;
+  writer.Start(WriterThreadCount(), 2 * inflight);
+
+  struct InFlightFrame {
+    int index;
+    std::vector<Color> pixels;
+    std::shared_ptr<RenderJob> job;
+  };
+  std::deque<InFlightFrame> pipeline;
+  int frameCount = keys.back().frame + 1;
+  auto start = std::chrono::steady_clock::now();
+
+  // Waits for the oldest frame and hands it to the writer
+  auto retireOldest = [&]() {
+    InFlightFrame &oldest = pipeline.front();
+    FinishRender(*oldest.job);
+    int index = oldest.index; // oldest is gone after pop_front
+
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%05d.", index);
+    writer.Submit({dir + name + ext, width, height, std::move(oldest.pixels)});
+    pipeline.pop_front();
+
+    printf("\rframe %d/%d", index + 1, frameCount);
+    fflush(stdout);
+  };
+
+  for (int frame = 0; frame < frameCount; frame++) {
+    if ((int)pipeline.size() >= inflight)
+      retireOldest();
+
+    ViewRequest view = InterpolateKeyframes(keys, frame, width, height);
+    view.formula = formula;
+    view.julia = julia;
+    view.juliaC = juliaC;
+    view.antialias = antialias;
+    view.smoothColoring = smoothColoring;
+    view.histogramColoring = histogramColoring;
+    view.distanceShading = distanceShading;
+    pipeline.push_back({frame, std::vector<Color>((size_t)width * height),
+                        nullptr});
+    pipeline.back().job = StartRender(view, pipeline.back().pixels.data());
+  }
+  while (!pipeline.empty())
+    retireOldest();
+  writer.Finish();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("\n%s: %d frames of %dx%d, %.1f s (%.2f fps)\n", dir.c_str(),
+         frameCount, width, height, seconds, frameCount / seconds);
+  return writer.failed.load() ? 1 : 0;
+}
+
+/*
+    Exponential map zoom: mandelbrot --expmap outdir [--center re im]
+                          [--span-start w] [--span-end w] [--frames N]
+                          [--size W H] [--iter n] [--formula F]
+                          [--ext png]
+
+    Consecutive frames of a zoom share almost all of their pixels at a
+    slightly different scale, so instead of iterating every frame this
+    renders one strip in log-polar coordinates around the zoom center:
+
+        column i -> angle  theta = (i + 0.5) * step
+        row j    -> radius r     = exp(logRadiusMax - (j + 0.5) * step)
+
+    Using the same step for angle and log radius makes the mapping
+    conformal, so strip pixels are square wherever they land. The strip
+    runs from the outer corner of the first frame down to half a pixel of
+    the last frame, with as many columns as the first frame's corner circle
+    has pixels around it.
+
+    Each video frame is then just a resample of the strip. A pixel's angle
+    and log radius in pixel units never change between frames; zooming
+    only adds log(span / width) to the log radius, i.e. shifts the rows.
+    So atan2 and log run once per pixel for the whole video, and each frame
+    costs one bilinear lookup per pixel.
+
+    A strip pixel at radius r is r * step wide, so each row is iterated in
+    the precision PrecisionForSpacing picks for that width: the outer rows
+    in float, the innermost ones of a deep zoom in double-double around
+    the center, which keeps all its digits.
+*/
+struct ExpMapStrip {
+  int formula = FORMULA_MANDELBROT;
+  int angles = 0; // Columns
+  int rows = 0;
+  DoubleDouble centerRe = {0.0, 0.0}, centerIm = {0.0, 0.0};
+  double logRadiusMax = 0.0;
+  double step = 0.0; // Angle and log-radius step per strip pixel
+  std::vector<Color> pixels;
+};
+
+// raylib's PI is a float, the strip needs the angle in full precision
+static const double TWO_PI = 6.283185307179586476925;
+
+void RenderExpMapTile(ExpMapStrip &strip, int maxIter, int tileX,
+                      int tileY) {
+  int startX = tileX * TILE_SIZE;
+  int endX = std::min(startX + TILE_SIZE, strip.angles);
+  int startY = tileY * TILE_SIZE;
+  int endY = std::min(startY + TILE_SIZE, strip.rows);
+
+  const FormulaKernels &kernels = FORMULAS[strip.formula];
+  for (int y = startY; y < endY; y++) {
+    double radius = exp(strip.logRadiusMax - (y + 0.5) * strip.step);
+    Color *row = &strip.pixels[(size_t)y * strip.angles];
+    KernelPrecision precision = PrecisionForSpacing(radius * strip.step);
+    if (precision == PRECISION_DOUBLE_DOUBLE) {
+      // DD_LANES pixels at a time
+      for (int x = startX; x < endX; x += DD_LANES) {
+        DoubleDouble cx[DD_LANES], cy[DD_LANES];
+        EscapeSample lanes[DD_LANES];
+        for (int l = 0; l < DD_LANES; l++) {
+          double theta = (x + l + 0.5) * strip.step;
+          cx[l] = DDAdd(strip.centerRe, radius * cos(theta));
+          cy[l] = DDAdd(strip.centerIm, radius * sin(theta));
+        }
+        kernels.doubleDoubleLanes(cx, cy, maxIter, false, lanes,
+                                  {0.0, 0.0});
+        for (int l = 0; l < std::min(DD_LANES, endX - x); l++)
+          row[x + l] = IterationColor((int)lanes[l].iterations, maxIter);
+      }
+      continue;
+    }
+    for (int x = startX; x < endX; x++) {
+      double theta = (x + 0.5) * strip.step;
+      double real = strip.centerRe.hi + radius * cos(theta);
+      double imag = strip.centerIm.hi + radius * sin(theta);
+      int n = kernels.escape[precision](real, imag, maxIter, nullptr,
+                                        {0.0, 0.0});
+      row[x] = IterationColor(n, maxIter);
+    }
+  }
+}
+
+// Per output pixel: strip column and row (before the per-frame shift)
+struct ExpMapLookup {
+  float column;
+  float row;
+};
+
+// Bilinear sample of the strip, wrapping in angle and clamping in radius
+inline Color SampleExpMap(const ExpMapStrip &strip, float column, float row) {
+  row = std::min(std::max(row, 0.0f), (float)(strip.rows - 1));
+  int x0 = (int)floorf(column);
+  int y0 = std::min((int)row, strip.rows - 2);
+  float fx = column - x0, fy = row - y0;
+  x0 = ((x0 % strip.angles) + strip.angles) % strip.angles;
+  int x1 = x0 + 1 == strip.angles ? 0 : x0 + 1;
+  y0 = std::max(y0, 0);
+  int y1 = std::min(y0 + 1, strip.rows - 1);
+
+  const Color &a = strip.pixels[(size_t)y0 * strip.angles + x0];
+  const Color &b = strip.pixels[(size_t)y0 * strip.angles + x1];
+  const Color &c = strip.pixels[(size_t)y1 * strip.angles + x0];
+  const Color &d = strip.pixels[(size_t)y1 * strip.angles + x1];
+  auto mix = [fx, fy](unsigned char p, unsigned char q, unsigned char r,
+                      unsigned char s) {
+    float top = p + (q - p) * fx;
+    float bottom = r + (s - r) * fx;
+    return (unsigned char)(top + (bottom - top) * fy + 0.5f);
+  };
+  return {mix(a.r, b.r, c.r, d.r), mix(a.g, b.g, c.g, d.g),
+          mix(a.b, b.b, c.b, d.b), 255};
+}
+
+int RunExpMap(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s --expmap outdir [--center re im] "
+                    "[--span-start w] [--span-end w] [--frames N] "
+                    "[--size W H] [--iter n] [--formula F] [--ext png]\n",
+            argv[0]);
+    return 1;
+  }
+
+  std::string dir = argv[2];
+  int width = atoi(FindOption(argc, argv, "--size", "1280", 1));
+  int height = atoi(FindOption(argc, argv, "--size", "720", 2));
+  int frames = std::max(1, atoi(FindOption(argc, argv, "--frames", "300")));
+  int maxIter = std::max(1, atoi(FindOption(argc, argv, "--iter", "1000")));
+  double spanStart = atof(FindOption(argc, argv, "--span-start", "3.5"));
+  double spanEnd = atof(FindOption(argc, argv, "--span-end", "1e-8"));
+  std::string ext = FindOption(argc, argv, "--ext", "png");
+  if (width <= 0 || height <= 0 || spanStart <= 0.0 || spanEnd <= 0.0 ||
+      spanEnd > spanStart) {
+    fprintf(stderr, "expmap: invalid size or spans\n");
+    return 1;
+  }
+  // Views stop at the same depth, see ViewFromCenter
+  if (spanEnd / width < DOUBLE_DOUBLE_MIN_SPACING) {
+    fprintf(stderr, "expmap: --span-end below %g is past the deepest zoom\n",
+            DOUBLE_DOUBLE_MIN_SPACING * width);
+    return 1;
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    fprintf(stderr, "expmap: cannot create %s: %s\n", dir.c_str(),
+            ec.message().c_str());
+    return 1;
+  }
+
+  // Strip geometry, radii in complex plane units
+  ExpMapStrip strip;
+  strip.formula = FormulaFromOptions(argc, argv);
+  strip.centerRe =
+      ParseDoubleDouble(FindOption(argc, argv, "--center", "-0.75", 1));
+  strip.centerIm =
+      ParseDoubleDouble(FindOption(argc, argv, "--center", "0", 2));
+  double cornerPixels =
+      0.5 * sqrt((double)width * width + (double)height * height);
+  strip.angles = (int)ceil(TWO_PI * cornerPixels);
+  strip.step = TWO_PI / strip.angles;
+  strip.logRadiusMax = log(cornerPixels * spanStart / width);
+  double logRadiusMin = log(0.5 * spanEnd / width);
+  strip.rows = std::max(
+      2, (int)ceil((strip.logRadiusMax - logRadiusMin) / strip.step));
+  strip.pixels.resize((size_t)strip.angles * strip.rows);
+  printf("strip: %d x %d (%.0f MB)\n", strip.angles, strip.rows,
+         strip.pixels.size() * sizeof(Color) / 1048576.0);
+
+  auto start = std::chrono::steady_clock::now();
+  FinishRender(*StartTileJob(strip.angles, strip.rows,
+                             [&strip, maxIter](int tileX, int tileY) {
+                               RenderExpMapTile(strip, maxIter, tileX, tileY);
+                             }));
+  double stripSeconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+
+  // Angle and log radius of every output pixel, in pixel units
+  std::vector<ExpMapLookup> lookup((size_t)width * height);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      double dx = x + 0.5 - width / 2.0;
+      double dy = height / 2.0 - (y + 0.5);
+      double theta = atan2(dy, dx);
+      if (theta < 0.0)
+        theta += TWO_PI;
+      double logRadius = 0.5 * log(std::max(dx * dx + dy * dy, 0.25));
+      lookup[(size_t)y * width + x] = {(float)(theta / strip.step - 0.5),
+                                       (float)(-logRadius / strip.step)};
+    }
+  }
+
+  AsyncImageWriter writer;
+  writer.Start(WriterThreadCount(), 8);
+
+  for (int frame = 0; frame < frames; frame++) {
+    // Log-spaced spans from spanStart to spanEnd
+    double t = frames > 1 ? (double)frame / (frames - 1) : 0.0;
+    double span = spanStart * pow(spanEnd / spanStart, t);
+
+    // Row of a pixel at log radius L (pixels): (logRadiusMax - L - log(span
+    // / width)) / step - 0.5, the frame-dependent part is one constant
+    float rowShift = (float)((strip.logRadiusMax - log(span / width)) /
+                                 strip.step -
+                             0.5);
+
+    std::vector<Color> pixels((size_t)width * height);
+    FinishRender(*StartTileJob(
+        width, height, [&, rowShift](int tileX, int tileY) {
+          int startX = tileX * TILE_SIZE;
+          int endX = std::min(startX + TILE_SIZE, width);
+          int startY = tileY * TILE_SIZE;
+          int endY = std::min(startY + TILE_SIZE, height);
+          for (int y = startY; y < endY; y++) {
+            for (int x = startX; x < endX; x++) {
+              const ExpMapLookup &l = lookup[(size_t)y * width + x];
+              pixels[(size_t)y * width + x] =
+                  SampleExpMap(strip, l.column, l.row + rowShift);
+            }
+          }
+        }));
+
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%05d.", frame);
+    writer.Submit({dir + name + ext, width, height, std::move(pixels)});
+    printf("\rframe %d/%d", frame + 1, frames);
+    fflush(stdout);
+  }
+  writer.Finish();
+
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("\n%s: %d frames of %dx%d, strip %.1f s, total %.1f s\n",
+         dir.c_str(), frames, width, height, stripSeconds, seconds);
+  return writer.failed.load() ? 1 : 0;
+}
+
+/*
+    Buddhabrot
+
+    A density plot of orbits instead of an escape time image: sample many
+    c, and for every orbit that escapes within maxIter (but not before
+    minIter) add each point z_1 .. z_n it visits to a histogram over the
+    view. mandelbrotEscape decides escape first, its cardioid, bulb and
+    interior checks drop most points of the set cheaply; only escaping
+    orbits are iterated a second time to plot them.
+
+    Samples are taken in chunks of BUDDHA_CHUNK, the tiles of a job. A
+    chunk borrows a shard, a float histogram of its own, for its whole
+    run and plots into it without atomics or locks, so workers never
+    write to the same cache line. Once a pass is done the shards are
+    summed into the double total by row blocks and cleared for the next
+    pass, in parallel for the batch mode and on the last worker of the
+    pass for the interactive one. There are never more shards than
+    workers.
+
+    Importance sampling: most of the c plane adds nothing to a view,
+    interior points never escape and far-out ones escape before they get
+    there. The first pass samples the BUDDHA_CELLS_X x BUDDHA_CELLS_Y grid
+    of cells uniformly and counts the hits each cell's orbits made. Later
+    passes pick cells in proportion to those counts, plus BUDDHA_FLOOR of
+    the mean so no cell is ruled out, and weight every hit by
+    1 / (cells * p), which keeps the density unbiased. Zoomed views get
+    their few contributing orbits many times faster this way.
+
+    The plot is symmetric about the real axis like the set, so only
+    Im(c) >= 0 is sampled and every orbit point is plotted along with its
+    conjugate.
+
+    The density is complete after every pass, so it can be shown as it
+    accumulates: --buddhabrot --progress rewrites the image after every
+    pass, the interactive B mode redraws it over the view.
+*/
+static const int BUDDHA_CELLS_X = 256; // Importance cells over Re -2 .. 2
+static const int BUDDHA_CELLS_Y = 128; // and Im 0 .. 2
+static const int BUDDHA_CHUNK = BUDDHA_CELLS_X * 16; // Samples per tile
+static const double BUDDHA_FLOOR = 0.5;
+// Shorter orbits only add a haze over the whole escape disk
+static const int BUDDHA_MIN_ITER = 20;
+
+// SplitMix64, a fast and well mixed generator for sample positions
+inline uint64_t SplitMix64(uint64_t &state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+inline double Random01(uint64_t &state) {
+  return (SplitMix64(state) >> 11) * 0x1p-53;
+}
+
+struct Buddhabrot {
+  int width, height;
+  double Re_min, Im_max, spacingX, spacingY;
+  int maxIter, minIter;
+
+  std::vector<double> density; // Weighted hits so far, row-major
+  std::vector<Color> image;    // Tone mapped density of a background pass
+  std::atomic<uint64_t> samples{0};
+  int passes = 0;
+
+  // Importance sampling, from the first pass
+  std::vector<uint32_t> cellHits;
+  std::vector<double> cellCdf; // Cumulative probability of the cells
+  std::vector<float> cellWeight;
+
+  std::mutex shardMutex; // Guards shards and freeShards
+  std::vector<std::unique_ptr<std::vector<float>>> shards;
+  std::vector<std::vector<float> *> freeShards;
+
+  Buddhabrot(const ViewRequest &view, int minIterations)
+      : width(view.width), height(view.height),
+        Re_min(view.anchorRe.hi + view.Re_min),
+        Im_max(view.anchorIm.hi + view.Im_max),
+        spacingX((view.Re_max - view.Re_min) / view.width),
+        spacingY((view.Im_max - view.Im_min) / view.height),
+        maxIter(view.maxIter), minIter(std::max(1, minIterations)),
+        density((size_t)width * height),
+        cellHits(BUDDHA_CELLS_X * BUDDHA_CELLS_Y) {}
 
-    - Many Points are known to be in the Mandelbrot set.
-      We can skip computations for these points.
-        - Points within the main cardioid -> Single check!
-        - Points within the period-2 bulb -> Single check!
+  std::vector<float> *AcquireShard() {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    if (freeShards.empty()) {
+      shards.push_back(
+          std::make_unique<std::vector<float>>((size_t)width * height));
+      return shards.back().get();
+    }
+    std::vector<float> *shard = freeShards.back();
+    freeShards.pop_back();
+    return shard;
+  }
 
-    -
+  void ReleaseShard(std::vector<float> *shard) {
+    std::lock_guard<std::mutex> lock(shardMutex);
+    freeShards.push_back(shard);
+  }
 
+  // Adds the orbit of c to shard with weight w, returns the hits
+  uint32_t PlotOrbit(double cx, double cy, int n, float w, float *shard) {
+    double invX = 1.0 / spacingX, invY = 1.0 / spacingY;
+    double zx = 0.0, zy = 0.0;
+    uint32_t hits = 0;
+    for (int k = 0; k < n; k++) {
+      double zx2 = zx * zx, zy2 = zy * zy;
+      Mandelbrot::Step(zx, zy, zx2, zy2, cx, cy);
+      double px = (zx - Re_min) * invX;
+      if (px < 0.0 || px >= width)
+        continue;
+      size_t column = (size_t)px;
+      double py = (Im_max - zy) * invY; // z
+      if (py >= 0.0 && py < height) {
+        shard[(size_t)py * width + column] += w;
+        hits++;
+      }
+      double qy = (Im_max + zy) * invY; // Its conjugate
+      if (qy >= 0.0 && qy < height) {
+        shard[(size_t)qy * width + column] += w;
+        hits++;
+      }
+    }
+    return hits;
+  }
 
+  // Samples chunk number chunk of the current pass
+  void RunChunk(int chunk) {
+    std::vector<float> *shard = AcquireShard();
+    uint64_t rng = ((uint64_t)passes << 32) ^ (uint64_t)chunk;
+    double cellWidth = 4.0 / BUDDHA_CELLS_X, cellHeight = 2.0 / BUDDHA_CELLS_Y;
+    bool scouting = passes == 0;
 
+    for (int s = 0; s < BUDDHA_CHUNK; s++) {
+      // The first pass takes row chunk of the cells, all cells alike
+      int cell = chunk * BUDDHA_CELLS_X + s % BUDDHA_CELLS_X;
+      float weight = 1.0f;
+      if (!scouting) {
+        cell = (int)(std::upper_bound(cellCdf.begin(), cellCdf.end(),
+                                      Random01(rng)) -
+                     cellCdf.begin());
+        cell = std::min(cell, (int)cellCdf.size() - 1);
+        weight = cellWeight[cell];
+      }
+      double cx = -2.0 + (cell % BUDDHA_CELLS_X + Random01(rng)) * cellWidth;
+      double cy = (cell / BUDDHA_CELLS_X + Random01(rng)) * cellHeight;
 
-*/
+      int n = mandelbrotEscape(cx, cy, maxIter);
+      if (n >= maxIter || n < minIter)
+        continue;
+      uint32_t hits = PlotOrbit(cx, cy, n, weight, shard->data());
+      if (scouting)
+        cellHits[cell] += hits; // Only this chunk samples the row
+    }
+    samples.fetch_add(BUDDHA_CHUNK, std::memory_order_relaxed);
+    ReleaseShard(shard);
+  }
 
-/* constants for the graphics!*/
-const int WIDTH = 900;
-const int HEIGHT = 900;
-const int MAX_ITER = 100;
-const int TILE_SIZE = 64; // Tile-based rendering for better load balancing
+  // Sums row block number block of the shards into density and clears it
+  void MergeShards(int block) {
+    size_t from = (size_t)block * TILE_SIZE * width;
+    size_t to =
+        std::min((size_t)(block + 1) * TILE_SIZE, (size_t)height) * width;
+    for (const auto &shard : shards) {
+      float *values = shard->data();
+      for (size_t i = from; i < to; i++) {
+        density[i] += values[i];
+        values[i] = 0.0f;
+      }
+    }
+  }
 
-// Global variables for interaction
-static Vector2 lastMousePos = {0, 0};
-static bool isDragging = false;
-static bool needsRedraw = true;
-static const double MIN_MOVEMENT =
-    2.0; // Minimum pixel movement to trigger redraw
-static const double DRAG_SENSITIVITY =
-    1.0; // Adjust this to make dragging faster/slower
-static bool isFullscreen = false;
+  // After a pass: sums the shards into density and clears them, and
+  // after the first one derives the cell probabilities from its hits.
+  // Only parallel when not called from a worker of the pool.
+  void FinishPass(bool parallel) {
+    int blocks = (height + TILE_SIZE - 1) / TILE_SIZE;
+    if (parallel)
+      ParallelFor(blocks, [this](int, int block) { MergeShards(block); });
+    else
+      for (int block = 0; block < blocks; block++)
+        MergeShards(block);
 
-// Splash screen state
-static bool showSplashScreen = true;
-static double splashTime = 0.0;
+    if (passes++ == 0) {
+      size_t cells = cellHits.size();
+      double mean = 0.0;
+      for (uint32_t hits : cellHits)
+        mean += hits;
+      mean = std::max(mean / cells, 1.0);
+      cellCdf.resize(cells);
+      cellWeight.resize(cells);
+      double total = 0.0;
+      for (size_t i = 0; i < cells; i++)
+        total += cellHits[i] + BUDDHA_FLOOR * mean;
+      double sum = 0.0;
+      for (size_t i = 0; i < cells; i++) {
+        double p = (cellHits[i] + BUDDHA_FLOOR * mean) / total;
+        sum += p;
+        cellCdf[i] = sum;
+        cellWeight[i] = (float)(1.0 / (cells * p));
+      }
+    }
+  }
 
-/* Faster than std::complex!*/
-struct Complex {
-  double real;
-  double imag;
+  // The density as an image: square root scaled so that the brightest
+  // 0.1% of the pixels saturate, which keeps a few hot spots from
+  // leaving the rest dark
+  void Colors(std::vector<Color> &out) const {
+    std::vector<double> sorted(density);
+    size_t top = std::min(sorted.size() - 1, sorted.size() * 999 / 1000);
+    std::nth_element(sorted.begin(), sorted.begin() + top, sorted.end());
+    double scale = sorted[top];
+    if (scale <= 0.0)
+      scale = *std::max_element(density.begin(), density.end());
+    scale = scale > 0.0 ? 1.0 / scale : 0.0;
+
+    out.resize(density.size());
+    for (size_t i = 0; i < density.size(); i++) {
+      double t = std::min(1.0, sqrt(density[i] * scale));
+      out[i] = {(unsigned char)(255 * t), (unsigned char)(255 * t * t),
+                (unsigned char)(255 * t * (1.5 - t)), 255};
+    }
+  }
 };
 
-/* Optimized Mandelbrot function with fast math */
-// inline is hint to the compiler for optimization
-inline int mandelbrotEscape(double cx, double cy, int max_iter) {
-  // Quick escape checks first
+// Queues the next pass of b, chunks tiles of BUDDHA_CHUNK samples (the
+// first pass always covers the cell grid once). A background pass is
+// finished by its last worker, which also tone maps the density into
+// b->image if toneMap is set.
+std::shared_ptr<RenderJob>
+StartBuddhabrotPass(const std::shared_ptr<Buddhabrot> &b, int chunks,
+                    CancelToken cancel = CancelToken(),
+                    bool background = false, bool toneMap = false) {
+  if (b->passes == 0)
+    chunks = BUDDHA_CELLS_Y;
+  // One tile per chunk
+  std::shared_ptr<RenderJob> job =
+      MakeTileJob(chunks * TILE_SIZE, TILE_SIZE, cancel);
+  job->renderTile = [b](int chunk, int) { b->RunChunk(chunk); };
+  if (background) {
+    job->lastTaskPass = [b, toneMap]() {
+      b->FinishPass(false);
+      if (toneMap)
+        b->Colors(b->image);
+    };
+  } else {
+    job->finishPass = [b]() { b->FinishPass(true); };
+  }
+  job->background = background;
+  LaunchTileJob(job);
+  return job;
+}
 
-  /* Cardioid check
+int RunBuddhabrot(int argc, char **argv) {
+  if (argc < 5) {
+    fprintf(stderr, "usage: %s --buddhabrot out.png W H [--center re im] "
+                    "[--span w] [--iter n] [--min-iter m] [--samples N] "
+                    "[--progress]\n",
+            argv[0]);
+    return 1;
+  }
 
-    q = (x - 0.25)^2 + y^2
-    (q * (q + (x - 0.25)) < 0.25 * y^2) -> inside cardioid
+  int width = atoi(argv[3]);
+  int height = atoi(argv[4]);
+  if (width <= 0 || height <= 0) {
+    fprintf(stderr, "buddhabrot: invalid size\n");
+    return 1;
+  }
+  ViewRequest view = ViewFromOptions(argc, argv, width, height);
+  view.maxIter = std::max(1, atoi(FindOption(argc, argv, "--iter", "1000")));
+  int minIter = atoi(FindOption(argc, argv, "--min-iter",
+                                std::to_string(BUDDHA_MIN_ITER).c_str()));
+  double target = atof(FindOption(argc, argv, "--samples", "1e7"));
+  bool progress = HasOption(argc, argv, "--progress");
 
-  */
+  auto b = std::make_shared<Buddhabrot>(view, minIter);
+  // About 20 passes, each still enough to keep every worker busy
+  int chunksPerPass = (int)std::min(
+      1e6, std::max(16.0 * RenderPool().Size(), target / BUDDHA_CHUNK / 20));
+  auto start = std::chrono::steady_clock::now();
+  std::vector<Color> pixels;
+  do {
+    FinishRender(*StartBuddhabrotPass(b, chunksPerPass));
+    printf("\rpass %d: %.3g samples", b->passes,
+           (double)b->samples.load(std::memory_order_relaxed));
+    fflush(stdout);
+    if (progress) {
+      b->Colors(pixels);
+      WriteImageFile({argv[2], width, height, pixels});
+    }
+  } while ((double)b->samples.load(std::memory_order_relaxed) < target);
 
-  double q = (cx - 0.25) * (cx - 0.25) + cy * cy;
-  if (q * (q + (cx - 0.25)) < 0.25 * cy * cy)
-    return max_iter;
+  b->Colors(pixels);
+  if (!WriteImageFile({argv[2], width, height, std::move(pixels)})) {
+    fprintf(stderr, "\nbuddhabrot: cannot write %s\n", argv[2]);
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("\n%s: %dx%d, %d iterations, %.1f s\n", argv[2], width, height,
+         view.maxIter, seconds);
+  return 0;
+}
 
-  /*
-    Bulb Check
-    (x + 1)^2 + y^2 < 1/16 -> inside period-2 bulb
-  */
+/*
+    Interactive Buddhabrot (B): accumulates the Buddhabrot of the view in
+    background passes (see WorkerPool) and shows it after each one, until
+    BUDDHA_INTERACTIVE_SAMPLES. A new view starts over. Merging and tone
+    mapping happen at the end of a pass on its last worker, the UI thread
+    only uploads the finished image.
+*/
+static const double BUDDHA_INTERACTIVE_SAMPLES = 5e7;
+static const double BUDDHA_REFRESH_SECONDS = 0.25;
 
-  if ((cx + 1) * (cx + 1) + cy * cy < 0.0625)
-    return max_iter;
+struct BuddhabrotDisplay {
+  std::atomic<uint64_t> generation{0};
+  std::shared_ptr<Buddhabrot> current;
+  std::shared_ptr<RenderJob> pass; // Of current, in flight
+  bool passToneMaps = false;       // Whether pass makes an image
+  ViewRequest view = {};           // What current covers
+  Texture2D texture = {};
+  bool hasImage = false;
+  double shownAt = 0.0; // GetTime() of the last texture update
 
-  /*
-    Outside check
-    x^2 + y^2 > 4 -> definitely outside
+  // Starts over on view unless that is what it shows already
+  void Request(const ViewRequest &next) {
+    if (current && next.width == view.width && next.height == view.height &&
+        next.Re_min == view.Re_min && next.Im_max == view.Im_max &&
+        next.Re_max == view.Re_max && next.maxIter == view.maxIter &&
+        next.anchorRe.hi == view.anchorRe.hi &&
+        next.anchorIm.hi == view.anchorIm.hi)
+      return;
+    generation.fetch_add(1); // Cancels the pass in flight
+    view = next;
+    current = std::make_shared<Buddhabrot>(view, BUDDHA_MIN_ITER);
+    pass = nullptr;
+    hasImage = false;
+  }
 
-  */
+  // UI thread, once per frame: shows a finished pass, starts the next
+  void Update() {
+    if (!current || (pass && !pass->Done()))
+      return;
+    if (pass && !FinishRender(*pass).cancelled && passToneMaps) {
+      if (texture.width != view.width || texture.height != view.height) {
+        if (texture.id != 0)
+          UnloadTexture(texture);
+        texture = LoadCanvasTexture(view.width, view.height);
+      }
+      UpdateTexture(texture, current->image.data());
+      hasImage = true;
+      shownAt = GetTime();
+    }
+    pass = nullptr;
 
-  if (cx * cx + cy * cy > 4.0)
-    return 0;
+    double samples = (double)current->samples.load(std::memory_order_relaxed);
+    if (samples >= BUDDHA_INTERACTIVE_SAMPLES)
+      return;
+    // Tone mapping sorts the whole density, not worth it every pass; the
+    // last one always shows its image
+    int chunks = 4 * RenderPool().Size();
+    passToneMaps =
+        !hasImage || GetTime() - shownAt >= BUDDHA_REFRESH_SECONDS ||
+        samples + (double)chunks * BUDDHA_CHUNK >= BUDDHA_INTERACTIVE_SAMPLES;
+    pass = StartBuddhabrotPass(current, chunks,
+                               {&generation, generation.load()}, true,
+                               passToneMaps);
+  }
 
-  // Fast iteration using registers
-  double zx = 0, zy = 0;
-  double zx2, zy2;
-  int n = 0;
+  void Draw() const {
+    if (!hasImage)
+      return;
+    DrawTexture(texture, 0, 0, WHITE);
+    DrawText(TextFormat("Buddhabrot: %.3g samples",
+                        (double)current->samples.load()),
+             10, 35, 20, GOLD);
+  }
 
-  /*
-    The escape time algorithm is based on the iterative function:
-        z(n+1) = z(n)² + c
-    where z and c are complex numbers.
+  // Cancels the pass in flight and waits for it
+  void Stop() {
+    generation.fetch_add(1);
+    if (pass)
+      FinishRender(*pass);
+    pass = nullptr;
+    current = nullptr;
+    if (texture.id != 0)
+      UnloadTexture(texture);
+    texture = {};
+    hasImage = false;
+  }
+};
 
-    In terms of real and imaginary parts:
-        z = zx + i*zy
-        c = cx + i*cy
+// Fills one tile chunk of the file layout for view
+void RenderSampleChunk(const ViewRequest &view, uint32_t channels, int tileX,
+                       int tileY, unsigned char *chunk) {
+  const size_t plane = (size_t)TILE_SIZE * TILE_SIZE;
+  uint32_t *iterations = nullptr;
+  float *smooth = nullptr, *distance = nullptr;
+  unsigned char *next = chunk;
+  if (channels & FXI_CHANNEL_ITERATIONS) {
+    iterations = (uint32_t *)next;
+    next += plane * 4;
+  }
+  if (channels & FXI_CHANNEL_SMOOTH) {
+    smooth = (float *)next;
+    next += plane * 4;
+  }
+  if (channels & FXI_CHANNEL_DISTANCE)
+    distance = (float *)next;
 
-    Squaring a complex number:
-        z² = (zx + i*zy)² = zx² - zy² + 2*i*zx*zy
+  int x0 = tileX * TILE_SIZE;
+  int count = std::clamp(view.width - x0, 0, TILE_SIZE);
+  for (int ty = 0; ty < TILE_SIZE; ty++) {
+    int y = tileY * TILE_SIZE + ty;
+    EscapeSample row[TILE_SIZE] = {}; // Zero is the padding outside the image
 
-    Therefore, the iteration becomes:
-        zx(n+1) = zx(n)² - zy(n)² + cx
-        zy(n+1) = 2*zx(n)*zy(n) + cy
-  */
+    if (y < view.height && distance) {
+      ViewDistanceRow(view, x0, y, count, row);
+    } else if (y < view.height) {
+      ViewSampleRow(view, x0, y, count, smooth != nullptr, row);
+    }
 
-  //  We unroll the loop for performance!
-  do {
-    zx2 = zx * zx;
-    zy2 = zy * zy;
-    zy = 2 * zx * zy + cy;
-    zx = zx2 - zy2 + cx;
-    n++;
-  } while (zx2 + zy2 <= 4.0 && n < max_iter);
+    for (int tx = 0; tx < TILE_SIZE; tx++) {
+      size_t i = (size_t)ty * TILE_SIZE + tx;
+      const EscapeSample &sample = row[tx];
+      if (iterations)
+        iterations[i] = sample.iterations;
+      if (smooth)
+        smooth[i] = sample.smooth;
+      if (distance)
+        distance[i] = sample.distance;
+    }
+  }
+}
 
-  return n;
+/*
+    Writes view as an .fxi file. Rendering runs one row of tiles at a time
+    on the pool; a tile row is contiguous in the file, so it is appended
+    with a single fwrite and memory stays at one row of chunks.
+*/
+bool WriteIterationFile(const char *path, const ViewRequest &view,
+                        uint32_t channels) {
+  FxiHeader header = {};
+  memcpy(header.magic, FXI_MAGIC, sizeof(FXI_MAGIC));
+  header.version = FXI_VERSION;
+  header.headerSize = FXI_HEADER_SIZE;
+  header.width = view.width;
+  header.height = view.height;
+  header.tileSize = TILE_SIZE;
+  header.channels = channels;
+  header.maxIter = view.maxIter;
+  header.formula = view.formula | (view.julia ? FXI_FORMULA_JULIA : 0);
+  if (view.julia) {
+    header.juliaRe = view.juliaC.real;
+    header.juliaIm = view.juliaC.imag;
+  }
+  // The file stores plain bounds, rounded to double for anchored views
+  header.reMin = view.anchorRe.hi + view.Re_min;
+  header.reMax = view.anchorRe.hi + view.Re_max;
+  header.imMin = view.anchorIm.hi + view.Im_min;
+  header.imMax = view.anchorIm.hi + view.Im_max;
+
+  FILE *file = fopen(path, "wb");
+  if (!file)
+    return false;
+  unsigned char headerBytes[FXI_HEADER_SIZE] = {};
+  memcpy(headerBytes, &header, sizeof(header));
+  bool ok = fwrite(headerBytes, 1, FXI_HEADER_SIZE, file) == FXI_HEADER_SIZE;
+
+  int tilesX = (view.width + TILE_SIZE - 1) / TILE_SIZE;
+  int tilesY = (view.height + TILE_SIZE - 1) / TILE_SIZE;
+  size_t chunkBytes = FxiChunkBytes(header);
+  std::vector<unsigned char> row(chunkBytes * tilesX);
+
+  for (int tileY = 0; tileY < tilesY && ok; tileY++) {
+    // One pool job over a single row of tiles
+    FinishRender(*StartTileJob(
+        view.width, TILE_SIZE, [&, tileY](int tileX, int) {
+          RenderSampleChunk(view, channels, tileX, tileY,
+                            row.data() + chunkBytes * tileX);
+        }));
+    ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+  }
+  return fclose(file) == 0 && ok;
 }
 
 /*
-    Simple:
-        We want to map left to right for the real part
-        and top to bottom for the imaginary part
+    Read-only memory-mapped view of an .fxi file. Sample(x, y) reads a
+    single pixel straight from the mapping; nothing is loaded up front.
+*/
+struct IterationFile {
+  FxiHeader header = {};
+  const unsigned char *data = nullptr;
+  size_t size = 0;
+  size_t chunkBytes = 0;
+  int tilesX = 0;
+#if defined(_WIN32)
+  HANDLE fileHandle = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
 
-        So we have:
-            real = real_min + (x / width) * (real_max - real_min)
-            imag = imag_max - (y / height) * (imag_max - imag_min)
+  IterationFile() = default;
+  IterationFile(const IterationFile &) = delete;
+  IterationFile &operator=(const IterationFile &) = delete;
+  ~IterationFile() { Close(); }
 
-        this is because the y axis is inverted
-        where the top left corner is at (0,0) and the
-        bottom left corner is (0, height)
+  bool Open(const char *path) {
+#if defined(_WIN32)
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0)
+      return false;
+    size = (size_t)fileSize.QuadPart;
+    mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0,
+                                 nullptr);
+    if (!mapping)
+      return false;
+    data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0,
+                                                0);
+    if (!data)
+      return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    size = (size_t)st.st_size;
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (mapped == MAP_FAILED)
+      return false;
+    data = (const unsigned char *)mapped;
+#endif
 
-        so, we see that the imag_max is at the top and
-        the imag_min is at the bottom and the real_min is
-        at the left and the real_max is at the right
+    // Validate before trusting any offsets
+    if (size < FXI_HEADER_SIZE)
+      return false;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, FXI_MAGIC, sizeof(FXI_MAGIC)) != 0 ||
+        header.version < 1 || header.version > FXI_VERSION ||
+        header.headerSize < FXI_HEADER_SIZE ||
+        header.tileSize != (uint32_t)TILE_SIZE ||
+        header.width == 0 || header.width > (uint32_t)INT_MAX ||
+        header.height == 0 || header.height > (uint32_t)INT_MAX ||
+        !(header.channels & FXI_CHANNEL_ITERATIONS))
+      return false;
+    // Sizes in 64 bits, and no more tiles than the file holds
+    uint64_t columns = ((uint64_t)header.width + TILE_SIZE - 1) / TILE_SIZE;
+    uint64_t rows = ((uint64_t)header.height + TILE_SIZE - 1) / TILE_SIZE;
+    tilesX = (int)columns;
+    chunkBytes = FxiChunkBytes(header);
+    if (size < header.headerSize)
+      return false;
+    return columns * rows <= (size - header.headerSize) / chunkBytes;
+  }
+
+  void Close() {
+#if defined(_WIN32)
+    if (data)
+      UnmapViewOfFile(data);
+    if (mapping)
+      CloseHandle(mapping);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+      CloseHandle(fileHandle);
+    mapping = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data)
+      munmap((void *)data, size);
+#endif
+    data = nullptr;
+  }
+
+  EscapeSample Sample(int x, int y) const {
+    uint32_t tileSize = header.tileSize;
+    size_t tile = (size_t)(y / tileSize) * tilesX + x / tileSize;
+    size_t i = (size_t)(y % tileSize) * tileSize + x % tileSize;
+    size_t plane = (size_t)tileSize * tileSize * 4;
+    const unsigned char *next = data + header.headerSize + tile * chunkBytes;
+
+    EscapeSample sample = {0, 0.0f, 0.0f};
+    memcpy(&sample.iterations, next + i * 4, 4);
+    next += plane;
+    if (header.channels & FXI_CHANNEL_SMOOTH) {
+      memcpy(&sample.smooth, next + i * 4, 4);
+      next += plane;
+    } else {
+      sample.smooth = (float)sample.iterations;
+    }
+    if (header.channels & FXI_CHANNEL_DISTANCE)
+      memcpy(&sample.distance, next + i * 4, 4);
+    return sample;
+  }
+};
 
+/*
+    mandelbrot --save-iter out.fxi W H [--center re im] [--span w]
+                                       [--iter n] [--distance]
+    mandelbrot --recolor in.fxi out.png [--crop x y w h] [--smooth]
+                                        [--distance]
 */
+int RunSaveIterations(int argc, char **argv) {
+  if (argc < 5) {
+    fprintf(stderr, "usage: %s --save-iter out.fxi W H [--center re im] "
+                    "[--span w] [--iter n] [--distance]\n",
+            argv[0]);
+    return 1;
+  }
 
-// Draw ASCII art splash screen
-void DrawSplashScreen(int screenWidth, int screenHeight, double time) {
-  ClearBackground(BLACK);
+  int width = atoi(argv[3]);
+  int height = atoi(argv[4]);
+  if (width <= 0 || height <= 0) {
+    fprintf(stderr, "save-iter: invalid size\n");
+    return 1;
+  }
+  ViewRequest view = ViewFromOptions(argc, argv, width, height);
+  view.maxIter = std::max(1, atoi(FindOption(argc, argv, "--iter", "1000")));
 
-  // Simple blinking
-  float blink = sin(time * 3.0f);
-  if (blink > 0) {
-    const char *prompt = "Press ENTER or click to begin...";
-    // Center the text by screenWidth - textWidth / 2 and screenHeight / 2
-    DrawText(prompt, (screenWidth - MeasureText(prompt, 40)) / 2, screenHeight / 2, 40,
-             YELLOW);
+  // --distance adds the distance estimate channel
+  uint32_t channels = FXI_CHANNEL_ITERATIONS | FXI_CHANNEL_SMOOTH;
+  if (view.distanceShading)
+    channels |= FXI_CHANNEL_DISTANCE;
+
+  auto start = std::chrono::steady_clock::now();
+  if (!WriteIterationFile(argv[2], view, channels)) {
+    fprintf(stderr, "save-iter: cannot write %s\n", argv[2]);
+    return 1;
   }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  printf("%s: %dx%d, %d iterations, %.1f s\n", argv[2], width, height,
+         view.maxIter, seconds);
+  return 0;
 }
 
-void RenderTile(int tileX, int tileY, int width, int height, double Re_min,
-                double Re_max, double Im_min, double Im_max,
-                Color *pixelBuffer) {
-  // Start of the tile in x direction
-  int startX = tileX * TILE_SIZE;
+int RunRecolor(int argc, char **argv) {
+  if (argc < 4) {
+    fprintf(stderr,
+            "usage: %s --recolor in.fxi out.png [--crop x y w h] [--smooth] "
+            "[--distance]\n",
+            argv[0]);
+    return 1;
+  }
 
-  // End of the tile in x direction
-  // Min because the tile might go out of bounds
-  int endX = std::min(startX + TILE_SIZE, width);
+  IterationFile file;
+  if (!file.Open(argv[2])) {
+    fprintf(stderr, "recolor: %s is not a valid iteration file\n", argv[2]);
+    return 1;
+  }
+  const FxiHeader &h = file.header;
 
-  // Start of the tile in y direction
-  int startY = tileY * TILE_SIZE;
+  // The stored view, colored with whatever the file has channels for
+  ViewRequest view = {(int)h.width, (int)h.height, h.reMin, h.reMax,
+                      h.imMin,      h.imMax,       (int)h.maxIter};
+  view.smoothColoring = HasOption(argc, argv, "--smooth") &&
+                        (h.channels & FXI_CHANNEL_SMOOTH);
+  view.distanceShading = HasOption(argc, argv, "--distance") &&
+                         (h.channels & FXI_CHANNEL_DISTANCE);
 
-  // End of the tile in y direction
-  // Min because the tile might go out of bounds
-  int endY = std::min(startY + TILE_SIZE, height);
+  // Crop rectangle, clamped to the image
+  int x0 = std::max(0, atoi(FindOption(argc, argv, "--crop", "0", 1)));
+  int y0 = std::max(0, atoi(FindOption(argc, argv, "--crop", "0", 2)));
+  int w = atoi(FindOption(argc, argv, "--crop", "0", 3));
+  int hgt = atoi(FindOption(argc, argv, "--crop", "0", 4));
+  w = std::min(w > 0 ? w : (int)h.width, (int)h.width - x0);
+  hgt = std::min(hgt > 0 ? hgt : (int)h.height, (int)h.height - y0);
+  if (w <= 0 || hgt <= 0) {
+    fprintf(stderr, "recolor: crop is outside the image\n");
+    return 1;
+  }
 
-  for (int y = startY; y < endY; y++) {
-    for (int x = startX; x < endX; x++) {
-      double real = Re_min + (x / (double)width) * (Re_max - Re_min);
-      double imag = Im_max - (y / (double)height) * (Im_max - Im_min);
-      int n = mandelbrotEscape(real, imag, MAX_ITER);
-
-      // Map the number of iterations to a color
-      Color color;
-      if (n == MAX_ITER) {
-        color = BLACK;
-      } else {
-        int hue = (int)(255.0 * n / MAX_ITER);
-        color = ColorFromHSV(hue, 0.5f, 1.2f);
+  ImageJob job = {argv[3], w, hgt, std::vector<Color>((size_t)w * hgt)};
+  FinishRender(*StartTileJob(w, hgt, [&](int tileX, int tileY) {
+    int endX = std::min((tileX + 1) * TILE_SIZE, w);
+    int endY = std::min((tileY + 1) * TILE_SIZE, hgt);
+    for (int y = tileY * TILE_SIZE; y < endY; y++)
+      for (int x = tileX * TILE_SIZE; x < endX; x++) {
+        EscapeSample sample = file.Sample(x0 + x, y0 + y);
+        job.pixels[(size_t)y * w + x] = ViewColor(
+            view, (int)sample.iterations, sample.smooth, sample.distance);
       }
+  }));
 
-      pixelBuffer[y * width + x] = color;
-    }
+  if (!WriteImageFile(job)) {
+    fprintf(stderr, "recolor: cannot write %s\n", argv[3]);
+    return 1;
   }
+  printf("%s: %dx%d crop of %ux%u\n", argv[3], w, hgt, h.width, h.height);
+  return 0;
 }
 
-int main() {
+int main(int argc, char **argv) {
+
+  // Batch modes only use the tile cache when asked to
+  DiskTileCache diskCache;
+  OpenTileCache(diskCache, argc, argv, nullptr);
+
+  // Headless modes run before any window is opened
+  if (argc >= 2 && std::string(argv[1]) == "--bench") {
+    return RunBenchmark(argc >= 3 ? std::max(1, atoi(argv[2])) : 10);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--check") {
+    return RunChecks();
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--poster") {
+    return RunPoster(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--pyramid") {
+    return RunPyramid(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--video") {
+    return RunVideo(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--expmap") {
+    return RunExpMap(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--buddhabrot") {
+    return RunBuddhabrot(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--save-iter") {
+    return RunSaveIterations(argc, argv);
+  }
+  if (argc >= 2 && std::string(argv[1]) == "--recolor") {
+    return RunRecolor(argc, argv);
+  }
+
+  OpenTileCache(diskCache, argc, argv, "tile_cache");
+
+  // Recently seen tiles stay in memory for zooming back and forth
+  MemoryTileCache tileMemory;
+  tileMemory.capacityBytes =
+      strtoull(FindOption(argc, argv, "--mem-cache-mb",
+                          std::to_string(DEFAULT_MEMORY_CACHE_MB).c_str()),
+               nullptr, 10)
+      << 20;
+  if (tileMemory.capacityBytes > 0)
+    memoryCache = &tileMemory;
 
   SetConfigFlags(FLAG_WINDOW_RESIZABLE); // Enable VSync and make window resizable
   InitWindow(WIDTH, HEIGHT, "Mandelbrot Explorer");
@@ -206,29 +5540,76 @@ int main() {
   /* Imaginary value to consider from min to max*/
   double Im_min = -1.5;
   double Im_max = 1.5;
+  // Deep views keep their corner here and Re_min .. Im_max relative to it
+  DoubleDouble anchorRe = {0.0, 0.0}, anchorIm = {0.0, 0.0};
 
-  // Image object but on the CPU Memory
-  Image image = GenImageColor(WIDTH, HEIGHT, RAYWHITE);
-  // Upload to the image from CPU to GPU and use VRAM for fast rendering
-  Texture2D texture = LoadTextureFromImage(image);
-  // Using Pixel Buffer to store the colors or cache
-  // 1. Makes it easy to implement symmetric property of Mandelbrot
-  // 2. Allows multi-threaded computation
-  std::vector<Color> pixelBuffer(WIDTH * HEIGHT);
+  // Each wheel step is one zoom level. Pixel spacing is derived from the
+  // level alone, so views land on the same pixel grid every session and
+  // the tile cache can reuse their tiles.
+  int zoomLevel = 0;
+
+  // Extra samples per edge pixel, toggled with A
+  int antialias = 0;
+  bool smoothColoring = false; // Toggled with S
+  bool histogramColoring = false; // Toggled with E
+  bool distanceShading = false;   // Toggled with D
+  int formula = FORMULA_MANDELBROT; // Cycled with N
+  // Julia set mode, toggled with J: the set of juliaC, picked under the
+  // cursor, and the Mandelbrot view to go back to
+  bool julia = false;
+  Complex juliaC = {0.0, 0.0};
+  ViewRequest juliaParent = {};
+  int juliaParentZoom = 0;
+  // Inset with the Julia set of the point under the cursor, toggled with P
+  JuliaPreview juliaPreview;
+  bool showJuliaPreview = false;
+  // Buddhabrot of the view over the escape time image, toggled with B
+  BuddhabrotDisplay buddhabrot;
+  bool showBuddhabrot = false;
+
+  // Texture on the GPU, use VRAM for fast rendering. It can be larger than
+  // the window, shownView tells which view its top-left part shows.
+  Texture2D texture = LoadCanvasTexture(WIDTH, HEIGHT);
+  ViewRequest shownView = {};
+  bool resizePending = false;
+  double lastResizeTime = 0.0;
+  // Pixel buffers live in the renderer's frames:
+  // workers fill the back frame while we upload the front one
+  BackgroundRenderer renderer;
+  renderer.Start();
+  std::vector<Color> uploadStaging;
+
+  // CPU copy of what the texture shows (shownView). A new render first
+  // resamples it into its own geometry, then lays its tiles in as they
+  // finish.
+  std::vector<Color> canvas, resampled;
+  DirtyRegion canvasDirty;
+  std::vector<TilePatch> patches;
+  bool canvasFollowsRender = false;
+  uint64_t canvasGeneration = 0; // Newest request the canvas shows
 
   // Force initial render
   bool hasRenderedOnce = false;
 
-  // To Prevent overlapping renders cause of multi-threading
-  bool isCurrentlyRendering = false;
-
   // Keep track of the current window size
   int currentWidth = WIDTH;
   int currentHeight = HEIGHT;
 
+  // Events recorded by the UI thread, flushed once per frame
+  std::vector<TraceEvent> uiTrace;
+
+  // Stats of the last render, shown by the H overlay
+  RenderStats lastStats;
+  bool showStats = false;
+
   while (!WindowShouldClose()) {
     splashTime += GetFrameTime();
 
+    // Hand over last frame's events, then open a span for this frame so
+    // frame boundaries show on the timeline
+    TraceSubmit(uiTrace);
+    TraceSpan frameSpan(TraceSink(uiTrace), "frame", "ui", 0);
+
     // Handle splash screen
     if (showSplashScreen) {
       BeginDrawing();
@@ -273,15 +5654,15 @@ int main() {
       currentWidth = newWidth;
       currentHeight = newHeight;
 
-      // Recreate image and texture with new size
-      UnloadTexture(texture);
-      UnloadImage(image);
-      image = GenImageColor(currentWidth, currentHeight, RAYWHITE);
-      texture = LoadTextureFromImage(image);
-      pixelBuffer.resize(currentWidth * currentHeight);
+      // Texture and render wait until the drag settles
+      resizePending = true;
+      lastResizeTime = GetTime();
+    }
 
+    if (resizePending && GetTime() - lastResizeTime > RESIZE_SETTLE_SECONDS) {
+      EnsureCanvasTexture(texture, currentWidth, currentHeight);
+      resizePending = false;
       needsRedraw = true;
-      hasRenderedOnce = false; // Force re-render with new size
     }
 
     // Handle mouse dragging for fractal panning
@@ -321,6 +5702,10 @@ int main() {
 
     // Handle zoom with mouse wheel
     float wheel = GetMouseWheelMove();
+    // No zooming in past the deepest level double-double resolves
+    if (wheel > 0 &&
+        3.0 / HEIGHT * pow(0.8, zoomLevel + 1) < DOUBLE_DOUBLE_MIN_SPACING)
+      wheel = 0;
     if (wheel != 0) {
       double mouseRe =
           Re_min + (mousePos.x / (double)currentWidth) * (Re_max - Re_min);
@@ -328,6 +5713,7 @@ int main() {
           Im_max - (mousePos.y / (double)currentHeight) * (Im_max - Im_min);
 
       double zoomFactor = (wheel > 0) ? 0.8 : 1.25; // Smoother zoom
+      zoomLevel += (wheel > 0) ? 1 : -1;
       double newWidth = (Re_max - Re_min) * zoomFactor;
       double newHeight = (Im_max - Im_min) * zoomFactor;
 
@@ -343,10 +5729,12 @@ int main() {
 
     // Reset view with R key
     if (IsKeyPressed(KEY_R)) {
-      Re_min = -2.0;
-      Re_max = 1.5;
+      Re_min = julia ? -1.75 : -2.0;
+      Re_max = julia ? 1.75 : 1.5;
       Im_min = -1.5;
       Im_max = 1.5;
+      anchorRe = anchorIm = {0.0, 0.0};
+      zoomLevel = 0;
       needsRedraw = true;
     }
 
@@ -372,68 +5760,264 @@ int main() {
       break;
     }
 
+    // Toggle edge anti-aliasing with A key
+    if (IsKeyPressed(KEY_A)) {
+      antialias = antialias ? 0 : AA_SAMPLES;
+      needsRedraw = true;
+    }
+
+    // Toggle smooth coloring with S key
+    if (IsKeyPressed(KEY_S)) {
+      smoothColoring = !smoothColoring;
+      needsRedraw = true;
+    }
+
+    // Toggle histogram-equalized coloring with E key
+    if (IsKeyPressed(KEY_E)) {
+      histogramColoring = !histogramColoring;
+      needsRedraw = true;
+    }
+
+    // Toggle distance estimation shading with D key
+    if (IsKeyPressed(KEY_D)) {
+      distanceShading = !distanceShading;
+      needsRedraw = true;
+    }
+
+    // Cycle through the formulas with N key
+    if (IsKeyPressed(KEY_N)) {
+      formula = (formula + 1) % FORMULA_COUNT;
+      needsRedraw = true;
+    }
+
+    // The point under the cursor, for the Julia set features
+    double mouseRe =
+        Re_min + (mousePos.x / (double)currentWidth) * (Re_max - Re_min);
+    double mouseIm =
+        Im_max - (mousePos.y / (double)currentHeight) * (Im_max - Im_min);
+    Complex cursorC = {DDAdd(anchorRe, mouseRe).hi,
+                       DDAdd(anchorIm, mouseIm).hi};
+
+    // Julia set of the point under the cursor with J key or a right click,
+    // J again returns to the view it was picked in
+    if (IsKeyPressed(KEY_J) ||
+        (!julia && IsMouseButtonPressed(MOUSE_BUTTON_RIGHT))) {
+      if (julia) {
+        Re_min = juliaParent.Re_min;
+        Re_max = juliaParent.Re_max;
+        Im_min = juliaParent.Im_min;
+        Im_max = juliaParent.Im_max;
+        anchorRe = juliaParent.anchorRe;
+        anchorIm = juliaParent.anchorIm;
+        zoomLevel = juliaParentZoom;
+      } else {
+        juliaC = JuliaParameter(cursorC);
+        juliaParent = {currentWidth, currentHeight, Re_min,
+                       Re_max,       Im_min,        Im_max};
+        juliaParent.anchorRe = anchorRe;
+        juliaParent.anchorIm = anchorIm;
+        juliaParentZoom = zoomLevel;
+
+        // The whole Julia set, centered on its point of symmetry
+        Re_min = -1.75;
+        Re_max = 1.75;
+        Im_min = -1.5;
+        Im_max = 1.5;
+        anchorRe = anchorIm = {0.0, 0.0};
+        zoomLevel = 0;
+      }
+      julia = !julia;
+      needsRedraw = true;
+    }
+
+    // Toggle the Julia preview with P key
+    if (IsKeyPressed(KEY_P)) {
+      showJuliaPreview = !showJuliaPreview;
+      if (!showJuliaPreview)
+        juliaPreview.Stop();
+    }
+
+    // Toggle the Buddhabrot with B key
+    if (IsKeyPressed(KEY_B)) {
+      showBuddhabrot = !showBuddhabrot;
+      if (!showBuddhabrot)
+        buddhabrot.Stop();
+      needsRedraw = true;
+    }
+
+    // Toggle the stats overlay with H key
+    if (IsKeyPressed(KEY_H)) {
+      showStats = !showStats;
+    }
+
+    // Toggle render tracing with T key
+    if (IsKeyPressed(KEY_T)) {
+      if (traceEnabled.load(std::memory_order_relaxed)) {
+        TraceStopAndWrite(RenderPool().Size());
+      } else {
+        TraceStart();
+      }
+    }
+
+    // Only recalculate if view changed, the render thread takes it from here
+    if (needsRedraw && !resizePending) {
+      // Snap to the zoom level's pixel grid, moving less than half a pixel,
+      // or re-anchor on the corner once the grid is too fine for a double
+      double zoom = pow(0.8, zoomLevel);
+      ViewRequest view = PlaceView(
+          currentWidth, currentHeight, 3.5 / WIDTH * zoom, 3.0 / HEIGHT * zoom,
+          DDAdd(anchorRe, Re_min), DDAdd(anchorIm, Im_max), MAX_ITER);
+      view.antialias = antialias;
+      view.smoothColoring = smoothColoring;
+      view.histogramColoring = histogramColoring;
+      view.formula = formula;
+      view.julia = julia;
+      view.juliaC = juliaC;
+      view.distanceShading = distanceShading && ViewKernels(view).distance;
+      anchorRe = view.anchorRe;
+      anchorIm = view.anchorIm;
+      Re_min = view.Re_min;
+      Re_max = view.Re_max;
+      Im_min = view.Im_min;
+      Im_max = view.Im_max;
+
+      renderer.Request(view);
+      // Orbits of z^2 + c only
+      if (showBuddhabrot && !julia && formula == FORMULA_MANDELBROT)
+        buddhabrot.Request(view);
+      else
+        buddhabrot.Stop();
+      needsRedraw = false;
+    }
+    buddhabrot.Update();
+
+    // The preview follows the cursor, behind the main view's render
+    if (showJuliaPreview && !julia)
+      juliaPreview.Request(cursorC, formula, smoothColoring);
+    juliaPreview.Update();
+
     /* Begin Drawing */
-    // Only render when needed
     BeginDrawing();
+    ClearBackground(BLACK);
 
-    // Only recalculate if view changed or first time AND not currently
-    // rendering
-    if ((needsRedraw || !hasRenderedOnce) && !isCurrentlyRendering) {
-      isCurrentlyRendering = true;
-      ClearBackground(BLACK);
-
-      // Create tiles for better load balancing
-      int tilesX = (currentWidth + TILE_SIZE - 1) / TILE_SIZE;
-      int tilesY = (currentHeight + TILE_SIZE - 1) / TILE_SIZE;
-      int totalTiles = tilesX * tilesY;
-
-      // Multi-threaded rendering
-      std::vector<std::thread> threads;
-      int numThreads = std::thread::hardware_concurrency();
-
-      // Distribute tiles among threads
-      for (int t = 0; t < numThreads; t++) {
-        threads.emplace_back([=, &pixelBuffer]() {
-          for (int tileIdx = t; tileIdx < totalTiles; tileIdx += numThreads) {
-            int tileX = tileIdx % tilesX;
-            int tileY = tileIdx / tilesX;
-            RenderTile(tileX, tileY, currentWidth, currentHeight, Re_min,
-                       Re_max, Im_min, Im_max, pixelBuffer.data());
-          }
-        });
+    // A render for a new view started: resample what is on screen into
+    // its geometry as a placeholder right away
+    ViewRequest startedView;
+    uint64_t startedGeneration;
+    if (renderer.TakeProgress(startedView, startedGeneration, patches)) {
+      canvasFollowsRender = startedView.width <= texture.width &&
+                            startedView.height <= texture.height;
+      if (canvasFollowsRender) {
+        if (hasRenderedOnce) {
+          ResampleView(canvas, shownView, resampled, startedView);
+          canvas.swap(resampled);
+        } else {
+          canvas.assign((size_t)startedView.width * startedView.height,
+                        BLACK);
+        }
+        shownView = startedView;
+        canvasGeneration = startedGeneration;
+        canvasDirty.Clear();
+        canvasDirty.Add(0, 0, startedView.width, startedView.height);
+        hasRenderedOnce = true;
+      }
+    }
+
+    // Then refine it with the tiles finished so far
+    if (canvasFollowsRender) {
+      for (const TilePatch &patch : patches) {
+        const DirtyRect &r = patch.rect;
+        for (int row = 0; row < r.height; row++)
+          std::copy(patch.pixels.begin() + (size_t)row * r.width,
+                    patch.pixels.begin() + (size_t)(row + 1) * r.width,
+                    canvas.begin() + (size_t)(r.y + row) * shownView.width +
+                        r.x);
+        canvasDirty.Add(r.x, r.y, r.width, r.height);
       }
+    }
+
+    // Swap in the newest completed frame, it replaces the canvas outright.
+    // A frame older than the render already refining the canvas is stale.
+    if (renderer.AcquireFrame()) {
+      Frame &frame = renderer.Front();
 
-      // Wait for all threads to finish
-      for (auto &thread : threads) {
-        thread.join();
+      // Frames rendered for an older window size may not fit the texture
+      if (frame.generation >= canvasGeneration &&
+          frame.width <= texture.width && frame.height <= texture.height) {
+        size_t count = (size_t)frame.width * frame.height;
+        canvas.assign(frame.pixels.begin(), frame.pixels.begin() + count);
+        canvasDirty.Clear();
+        canvasDirty.rects.swap(frame.dirty.rects);
+        shownView = frame.view;
+        canvasGeneration = frame.generation;
+        canvasFollowsRender = false;
+        lastStats = frame.stats;
+        hasRenderedOnce = true;
       }
+    }
 
-      // Update texture with new pixel data (GPU acceleration)
-      UpdateTexture(texture, pixelBuffer.data());
-      needsRedraw = false;
-      hasRenderedOnce = true;
-      isCurrentlyRendering = false;
+    if (!canvasDirty.Empty()) {
+      TraceSpan uploadSpan(TraceSink(uiTrace), "upload", "gpu", 0);
+      UploadDirtyRegion(texture, canvas.data(), shownView.width, canvasDirty,
+                        uploadStaging);
     }
 
     // Only draw the texture if we have rendered at least once
     if (hasRenderedOnce) {
-      DrawTexture(texture, 0, 0, WHITE);
+      ViewRequest screenView = {currentWidth, currentHeight, Re_min,
+                                Re_max,       Im_min,        Im_max};
+      screenView.anchorRe = anchorRe;
+      screenView.anchorIm = anchorIm;
+      DrawReprojected(texture, shownView, screenView);
     }
+    buddhabrot.Draw();
 
     // Show controls in bottom-left corner
-    DrawText("Controls: F=Fullscreen, M=Minimize, R=Reset, Q=Quit", 10,
-             currentHeight - 25, 16, LIME);
+    DrawText("Controls: F=Fullscreen, M=Minimize, R=Reset, A=Antialias, "
+             "S=Smooth, E=Equalize, D=Distance, N=Formula, J=Julia, "
+             "P=Preview, B=Buddhabrot, H=Stats, T=Trace, Q=Quit",
+             10, currentHeight - 25, 16, LIME);
+
+    if (showStats) {
+      DrawStatsHud(lastStats, renderer.Busy());
+    }
+
+    if (showJuliaPreview && !julia) {
+      juliaPreview.Draw(currentWidth - JULIA_PREVIEW_SIZE - 10,
+                        currentHeight - JULIA_PREVIEW_SIZE - 50);
+    }
+
+    // Recording indicator while a trace is being captured
+    if (traceEnabled.load(std::memory_order_relaxed)) {
+      DrawText("REC TRACE", 10, 10, 20, RED);
+    }
 
     // Add logo/watermark in top-right corner
     DrawText("MANDELBROT", currentWidth - 150, 10, 20, GOLD);
     DrawText("EXPLORER", currentWidth - 90, 35, 14, ORANGE);
+    if (formula != FORMULA_MANDELBROT)
+      DrawText(FORMULAS[formula].name, currentWidth - 150, 55, 14, ORANGE);
+    if (julia)
+      DrawText(TextFormat("julia %.6f %+.6fi", juliaC.real, juliaC.imag),
+               currentWidth - 150, 70, 14, ORANGE);
 
     EndDrawing();
   }
 
+  juliaPreview.Stop();
+  buddhabrot.Stop();
+  renderer.Stop();
+  memoryCache = nullptr;
+  diskCache.Close();
+
+  // Don't lose a trace that is still recording
+  if (traceEnabled.load(std::memory_order_relaxed)) {
+    TraceSubmit(uiTrace);
+    TraceStopAndWrite(RenderPool().Size());
+  }
+
   // Clean up resources
   UnloadTexture(texture);
-  UnloadImage(image);
 
   CloseWindow();
 